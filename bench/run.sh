@@ -0,0 +1,16 @@
+#!/usr/bin/env sh
+#
+# build and run the benchmarks, and write the JSON results to bench/results/.
+#
+# usage: sh ./bench/run.sh
+#   CC, CFLAGS and LIBS are passed to the C compiler, and LUA is used to run
+#   the Lua driver against the installed os.urandom module.
+#
+set -ex
+
+cd "$(dirname "$0")"
+mkdir -p ./results
+
+${CC:-cc} -O2 ${CFLAGS} -o ./results/secrandom_bench secrandom_bench.c ${LIBS}
+./results/secrandom_bench > ./results/secrandom.json
+${LUA:-lua} ./urandom_bench.lua > ./results/urandom.json
@@ -0,0 +1,167 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/**
+ * microbenchmark of the backends in secrandom.h and the chacha20 pool.
+ * the results are written to stdout as a JSON array.
+ */
+
+// project
+#include "../src/chacha20.h"
+#include "../src/secrandom.h"
+// system
+#include <stdio.h>
+#include <stdlib.h>
+
+// number of bytes generated by each measurement
+#define BENCH_TOTAL_SIZE (64 * 1024 * 1024)
+#define BENCH_MIN_ITER   4
+#define BENCH_MAX_ITER   100000
+
+static const size_t SIZES[] = {
+    1,
+    16,
+    256,
+    4096,
+    65536,
+    1024 * 1024,
+    16 * 1024 * 1024,
+};
+
+static int FIRST = 1;
+
+static uint64_t iterations(size_t size)
+{
+    uint64_t iter = BENCH_TOTAL_SIZE / size;
+
+    if (iter < BENCH_MIN_ITER) {
+        return BENCH_MIN_ITER;
+    } else if (iter > BENCH_MAX_ITER) {
+        return BENCH_MAX_ITER;
+    }
+    return iter;
+}
+
+static void report(const char *name, size_t size, uint64_t iter,
+                   uint64_t elapsed)
+{
+    double ns = (double)elapsed / (double)iter;
+
+    printf("%s\n    {\"name\": \"%s\", \"size\": %zu, \"iterations\": %llu, "
+           "\"ns_per_call\": %.1f, \"gb_per_sec\": %.3f}",
+           FIRST ? "" : ",", name, size, (unsigned long long)iter, ns,
+           (double)size / ns);
+    FIRST = 0;
+}
+
+static int bench_backend(const secrandom_backend_t *b, void *buf)
+{
+    char name[64];
+    int fd = -1;
+
+    snprintf(name, sizeof(name), "secrandom/%s", b->name);
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        uint64_t iter  = iterations(SIZES[i]);
+        uint64_t start = secrandom_clock_ns();
+
+        for (uint64_t n = 0; n < iter; n++) {
+            if (b->func(buf, SIZES[i], &fd) != SECRANDOM_SUCCESS) {
+                fprintf(stderr, "%s: failed to generate %zu bytes\n", name,
+                        SIZES[i]);
+                return -1;
+            }
+        }
+        report(name, SIZES[i], iter, secrandom_clock_ns() - start);
+    }
+#if !defined(_WIN32)
+    if (fd != -1) {
+        close(fd);
+    }
+#endif
+    return 0;
+}
+
+static int pool_fill(chacha20_pool_t *pool, void *buf, size_t len)
+{
+    if (chacha20_pool_needs_reseed(pool)) {
+        uint8_t seed[CHACHA20_KEY_SIZE];
+        if (secrandom(seed, sizeof(seed), NULL) != SECRANDOM_SUCCESS) {
+            return -1;
+        }
+        chacha20_pool_reseed(pool, seed);
+        chacha20_wipe(seed, sizeof(seed));
+    }
+    chacha20_pool_fill(pool, buf, len);
+    return 0;
+}
+
+static int bench_pool(void *buf)
+{
+    chacha20_pool_t pool = {0};
+
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        uint64_t iter  = iterations(SIZES[i]);
+        uint64_t start = secrandom_clock_ns();
+
+        for (uint64_t n = 0; n < iter; n++) {
+            if (pool_fill(&pool, buf, SIZES[i]) != 0) {
+                fprintf(stderr, "chacha20_pool: failed to reseed\n");
+                return -1;
+            }
+        }
+        report("chacha20_pool", SIZES[i], iter, secrandom_clock_ns() - start);
+    }
+    chacha20_pool_wipe(&pool);
+    return 0;
+}
+
+int main(void)
+{
+    unsigned char probe[16];
+    void *buf = malloc(SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1]);
+    int rc    = EXIT_SUCCESS;
+
+    if (buf == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    printf("[");
+    for (const secrandom_backend_t *b = secrandom_backends(); b->name; b++) {
+        if (b->func(probe, sizeof(probe), NULL) != SECRANDOM_SUCCESS) {
+            fprintf(stderr, "secrandom/%s: not available, skipped\n",
+                    b->name);
+            continue;
+        }
+        if (bench_backend(b, buf) != 0) {
+            rc = EXIT_FAILURE;
+        }
+    }
+    if (bench_pool(buf) != 0) {
+        rc = EXIT_FAILURE;
+    }
+    printf("\n]\n");
+
+    free(buf);
+    return rc;
+}
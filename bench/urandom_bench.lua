@@ -0,0 +1,133 @@
+--
+-- benchmark of the os.urandom API in each mode and backend.
+-- the results are written to stdout as a JSON array.
+--
+-- usage: lua bench/urandom_bench.lua
+--
+local urandom = require('os.urandom')
+local clock = os.clock
+
+-- number of bytes generated by each measurement
+local TOTAL_SIZE = 64 * 1024 * 1024
+local MIN_ITER = 4
+local MAX_ITER = 100000
+
+local SIZES = {
+    1,
+    16,
+    256,
+    4096,
+    65536,
+    1024 * 1024,
+    16 * 1024 * 1024,
+}
+
+local function iterations(size)
+    local iter = math.floor(TOTAL_SIZE / size)
+    if iter < MIN_ITER then
+        return MIN_ITER
+    elseif iter > MAX_ITER then
+        return MAX_ITER
+    end
+    return iter
+end
+
+local FORMAT =
+    '    {"mode": "%s", "method": "%s", "size": %d, "iterations": %d, "ns_per_call": %.1f, "gb_per_sec": %.3f}'
+local RESULTS = {}
+
+local function report(mode, method, size, iter, elapsed)
+    local ns = elapsed * 1e9 / iter
+    RESULTS[#RESULTS + 1] = FORMAT:format(mode, method, size, iter, ns,
+                                          size / ns)
+end
+
+local function bench(mode, method, size, iter, fn)
+    -- warm up
+    assert(fn())
+    local start = clock()
+    for _ = 1, iter do
+        fn()
+    end
+    report(mode, method, size, iter, clock() - start)
+end
+
+local function bench_instance(mode, u)
+    for _, size in ipairs(SIZES) do
+        bench(mode, 'bytes', size, iterations(size), function()
+            return u:bytes(size)
+        end)
+    end
+    bench(mode, 'get32u', 1024 * 4, iterations(1024 * 4), function()
+        return u:get32u(1024)
+    end)
+    bench(mode, 'u32', 4, MAX_ITER, function()
+        return u:u32()
+    end)
+    bench(mode, 'double', 8, MAX_ITER, function()
+        return u:double()
+    end)
+    bench(mode, 'range', 4, MAX_ITER, function()
+        return u:range(1, 6)
+    end)
+    bench(mode, 'hex', 16, MAX_ITER, function()
+        return u:hex(16)
+    end)
+    bench(mode, 'tokens', 16 * 16, iterations(16 * 16), function()
+        return u:tokens(16, 16)
+    end)
+end
+
+local MODES = {
+    {
+        'default',
+    },
+    {
+        'pool',
+        {
+            pool = 'chacha20',
+        },
+    },
+    {
+        'buffer',
+        {
+            buffer = 65536,
+        },
+    },
+    {
+        'pool+buffer',
+        {
+            pool = 'chacha20',
+            buffer = 65536,
+        },
+    },
+}
+for _, name in ipairs({
+    'openssl',
+    'arc4random',
+    'getrandom',
+    'getentropy',
+    'urandom',
+    'bcrypt',
+    'fastest',
+}) do
+    MODES[#MODES + 1] = {
+        'backend=' .. name,
+        {
+            backend = name,
+        },
+    }
+end
+
+for _, v in ipairs(MODES) do
+    local ok, u = pcall(urandom, v[2])
+    if ok and u then
+        bench_instance(v[1], u)
+    else
+        io.stderr:write(v[1], ': not available, skipped\n')
+    end
+end
+
+print('[')
+print(table.concat(RESULTS, ',\n'))
+print(']')
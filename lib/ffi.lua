@@ -0,0 +1,216 @@
+--
+-- Copyright (C) 2025 Masatoshi Fukunaga
+--
+-- Permission is hereby granted, free of charge, to any person obtaining a copy
+-- of this software and associated documentation files (the "Software"), to
+-- deal in the Software without restriction, including without limitation the
+-- rights to use, copy, modify, merge, publish, distribute, sublicense,
+-- and/or sell copies of the Software, and to permit persons to whom the
+-- Software is furnished to do so, subject to the following conditions:
+--
+-- The above copyright notice and this permission notice shall be included in
+-- all copies or substantial portions of the Software.
+--
+-- THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+-- IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+-- FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+-- AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+-- LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+-- FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+-- DEALINGS IN THE SOFTWARE.
+--
+-- wrapper of os.urandom that calls os_urandom_fill() through the LuaJIT FFI,
+-- so that the hot loops stay JIT-compiled. it falls back to the methods of
+-- os.urandom on the other Lua implementations.
+--
+local error = error
+local find = string.find
+local ipairs = ipairs
+local pcall = pcall
+local setmetatable = setmetatable
+local tonumber = tonumber
+local tostring = tostring
+local type = type
+local is_instance = require('os.urandom').is_instance
+
+-- shared object of os.urandom; it is kept referenced while fill is used
+local LIB
+
+--- load os_urandom_fill() from the shared object of os.urandom, or from the
+--- host if os.urandom is linked statically.
+--- @return table? ffi
+--- @return function? fill
+local function load_ffi()
+    local ok, ffi = pcall(require, 'ffi')
+    if not ok then
+        return
+    end
+
+    -- it fails if the declaration already exists
+    pcall(ffi.cdef, [[
+        int os_urandom_fill(void *u, void *buf, size_t len);
+    ]])
+    -- the module is loaded with RTLD_LOCAL, so its symbols are not in ffi.C
+    local path = package.searchpath and
+                     package.searchpath('os.urandom', package.cpath)
+    for _, loader in ipairs({
+        function()
+            LIB = ffi.load(path)
+            return LIB.os_urandom_fill
+        end,
+        function()
+            return ffi.C.os_urandom_fill
+        end,
+    }) do
+        local fill
+        ok, fill = pcall(loader)
+        if ok then
+            return ffi, fill
+        end
+    end
+end
+
+local ffi, fill = load_ffi()
+
+--- @class os.urandom.ffi
+--- @field u os.urandom
+--- @field ptr ffi.cdata*?
+local FFI = {}
+FFI.__index = FFI
+
+function FFI:__tostring()
+    return 'os.urandom.ffi: ' .. tostring(self.u)
+end
+
+if ffi then
+    local ffi_new = ffi.new
+    local ffi_string = ffi.string
+    local ffi_copy = ffi.copy
+    local ffi_fill = ffi.fill
+    local ffi_sizeof = ffi.sizeof
+    local ffi_typeof = ffi.typeof
+    local U32 = ffi_new('uint32_t[1]')
+    local U64 = ffi_new('uint64_t[1]')
+    -- scratch buffer of bytes(), grown to the largest request
+    local SCRATCH = ffi_new('uint8_t[?]', 256)
+    local SCRATCH_SIZE = 256
+    local DBL_EPSILON_HALF = 2 ^ -53
+    -- the methods load the words as little-endian, and the words below are
+    -- loaded in the native byte order
+    local NATIVE_LE = ffi.abi('le')
+
+    --- check that len bytes can be written into the buffer.
+    --- @param buf ffi.cdata*
+    --- @param len integer
+    local function check_len(buf, len)
+        if type(len) ~= 'number' or len < 0 or len % 1 ~= 0 then
+            error('len must be a non-negative integer, got ' .. tostring(len),
+                  3)
+        end
+        -- the size of the array is known, but not the size of the memory
+        -- that the pointer points to
+        if find(tostring(ffi_typeof(buf)), '%]>$') then
+            local size = ffi_sizeof(buf)
+            if size and len > size then
+                error('len out of range of the buffer of ' .. size ..
+                          ' bytes', 3)
+            end
+        end
+    end
+
+    --- fill the buffer with random bytes.
+    --- @param buf ffi.cdata*
+    --- @param len integer
+    --- @return boolean ok
+    --- @return any err
+    function FFI:fill(buf, len)
+        check_len(buf, len)
+        if fill(self.ptr, buf, len) ~= 0 then
+            -- read through the C API to get the error object
+            local s, err = self.u:bytes(len)
+            if not s then
+                return false, err
+            end
+            ffi_copy(buf, s, len)
+        end
+        return true
+    end
+
+    --- get random bytes.
+    --- @param nbyte integer
+    --- @return string? s
+    --- @return any err
+    function FFI:bytes(nbyte)
+        if type(nbyte) ~= 'number' or nbyte < 0 or nbyte % 1 ~= 0 then
+            error('nbyte must be a non-negative integer, got ' ..
+                      tostring(nbyte), 2)
+        end
+        if nbyte > SCRATCH_SIZE then
+            SCRATCH = ffi_new('uint8_t[?]', nbyte)
+            SCRATCH_SIZE = nbyte
+        end
+        if fill(self.ptr, SCRATCH, nbyte) ~= 0 then
+            return self.u:bytes(nbyte)
+        end
+        local s = ffi_string(SCRATCH, nbyte)
+        ffi_fill(SCRATCH, nbyte)
+        return s
+    end
+
+    --- get a random 32-bit unsigned integer.
+    --- @return integer? v
+    --- @return any err
+    function FFI:u32()
+        if not NATIVE_LE or fill(self.ptr, U32, 4) ~= 0 then
+            return self.u:u32()
+        end
+        return U32[0]
+    end
+
+    --- get a random floating-point number in [0, 1).
+    --- @return number? v
+    --- @return any err
+    function FFI:double()
+        if not NATIVE_LE or fill(self.ptr, U64, 8) ~= 0 then
+            return self.u:double()
+        end
+        -- use the upper 53 bits as the mantissa
+        return tonumber(U64[0] / 2048) * DBL_EPSILON_HALF
+    end
+else
+    function FFI:fill(buf, len)
+        return self.u:fill(buf, 0, len)
+    end
+
+    function FFI:bytes(nbyte)
+        return self.u:bytes(nbyte)
+    end
+
+    function FFI:u32()
+        return self.u:u32()
+    end
+
+    function FFI:double()
+        return self.u:double()
+    end
+end
+
+--- wrap the instance of os.urandom.
+--- @param u os.urandom|os.urandom.seeded
+--- @return os.urandom.ffi
+local function wrap(u)
+    if not is_instance(u) then
+        error('os.urandom instance expected, got ' .. tostring(u), 2)
+    end
+    return setmetatable({
+        u = u,
+        -- address of the payload of the userdata
+        ptr = ffi and ffi.cast('void *', u),
+    }, FFI)
+end
+
+return {
+    -- true if the functions are called through the LuaJIT FFI
+    available = ffi ~= nil,
+    wrap = wrap,
+}
@@ -0,0 +1,352 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef chacha20_h
+#define chacha20_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CHACHA20_KEY_SIZE   32
+#define CHACHA20_BLOCK_SIZE 64
+/* number of keystream bytes generated per rekey of the pool */
+#define CHACHA20_POOL_SIZE  (CHACHA20_BLOCK_SIZE * 16)
+/* number of bytes the pool produces before it is reseeded */
+#define CHACHA20_POOL_RESEED_INTERVAL (1024 * 1024)
+
+/**
+ * @brief Overwrite the buffer with zeros in a way that is not optimized away.
+ *
+ * @param buf Pointer to the buffer to be wiped.
+ * @param len Number of bytes to wipe.
+ */
+static inline void chacha20_wipe(void *buf, size_t len)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    memset(buf, 0, len);
+    __asm__ __volatile__("" : : "r"(buf) : "memory");
+#else
+    volatile unsigned char *p = buf;
+    while (len--) {
+        *p++ = 0;
+    }
+#endif
+}
+
+static inline uint32_t chacha20_load32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static inline void chacha20_store32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+#define CHACHA20_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA20_QR(a, b, c, d)                                                \
+    do {                                                                       \
+        a += b;                                                                \
+        d ^= a;                                                                \
+        d = CHACHA20_ROTL(d, 16);                                              \
+        c += d;                                                                \
+        b ^= c;                                                                \
+        b = CHACHA20_ROTL(b, 12);                                              \
+        a += b;                                                                \
+        d ^= a;                                                                \
+        d = CHACHA20_ROTL(d, 8);                                               \
+        c += d;                                                                \
+        b ^= c;                                                                \
+        b = CHACHA20_ROTL(b, 7);                                               \
+    } while (0)
+
+/**
+ * @brief Compute a single ChaCha20 keystream block.
+ *
+ * This uses the original layout with a 64-bit block counter and a 64-bit
+ * nonce, so a single key can produce up to 2^70 bytes of keystream.
+ *
+ * @param key 256-bit key as eight little-endian words.
+ * @param nonce 64-bit nonce.
+ * @param counter 64-bit block counter.
+ * @param out Pointer to the 64 bytes buffer where the block will be stored.
+ */
+static inline void chacha20_block(const uint32_t key[8], uint64_t nonce,
+                                  uint64_t counter, uint8_t *out)
+{
+    const uint32_t in[16] = {
+        0x61707865,
+        0x3320646e,
+        0x79622d32,
+        0x6b206574,
+        key[0],
+        key[1],
+        key[2],
+        key[3],
+        key[4],
+        key[5],
+        key[6],
+        key[7],
+        (uint32_t)counter,
+        (uint32_t)(counter >> 32),
+        (uint32_t)nonce,
+        (uint32_t)(nonce >> 32),
+    };
+    uint32_t x[16];
+
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        /* column rounds */
+        CHACHA20_QR(x[0], x[4], x[8], x[12]);
+        CHACHA20_QR(x[1], x[5], x[9], x[13]);
+        CHACHA20_QR(x[2], x[6], x[10], x[14]);
+        CHACHA20_QR(x[3], x[7], x[11], x[15]);
+        /* diagonal rounds */
+        CHACHA20_QR(x[0], x[5], x[10], x[15]);
+        CHACHA20_QR(x[1], x[6], x[11], x[12]);
+        CHACHA20_QR(x[2], x[7], x[8], x[13]);
+        CHACHA20_QR(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        chacha20_store32(out + i * 4, x[i] + in[i]);
+    }
+    chacha20_wipe(x, sizeof(x));
+}
+
+#undef CHACHA20_QR
+#undef CHACHA20_ROTL
+
+/**
+ * @brief Write the ChaCha20 keystream into the buffer.
+ *
+ * @param key 256-bit key as eight little-endian words.
+ * @param nonce 64-bit nonce.
+ * @param counter Block counter of the first block.
+ * @param buf Pointer to the buffer where the keystream will be stored.
+ * @param len Number of bytes to generate.
+ */
+static inline void chacha20_keystream(const uint32_t key[8], uint64_t nonce,
+                                      uint64_t counter, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    while (len >= CHACHA20_BLOCK_SIZE) {
+        chacha20_block(key, nonce, counter++, p);
+        p += CHACHA20_BLOCK_SIZE;
+        len -= CHACHA20_BLOCK_SIZE;
+    }
+    if (len) {
+        uint8_t block[CHACHA20_BLOCK_SIZE];
+        chacha20_block(key, nonce, counter, block);
+        memcpy(p, block, len);
+        chacha20_wipe(block, sizeof(block));
+    }
+}
+
+/**
+ * @brief Userspace CSPRNG based on the ChaCha20 keystream with fast key
+ * erasure.
+ *
+ * Each rekey generates CHACHA20_POOL_SIZE bytes of keystream; the first
+ * CHACHA20_KEY_SIZE bytes replace the key and the rest are handed out. Every
+ * byte is wiped once it has been handed out, so neither past outputs nor past
+ * keys can be recovered from the state.
+ */
+typedef struct {
+    uint32_t key[8];
+    uint8_t buf[CHACHA20_POOL_SIZE];
+    size_t avail; // number of unread bytes at the tail of buf
+    size_t nread; // number of bytes produced since the last reseed
+    int seeded;
+} chacha20_pool_t;
+
+static inline void chacha20_pool_rekey(chacha20_pool_t *pool)
+{
+    chacha20_keystream(pool->key, 0, 0, pool->buf, CHACHA20_POOL_SIZE);
+    for (int i = 0; i < 8; i++) {
+        pool->key[i] = chacha20_load32(pool->buf + i * 4);
+    }
+    chacha20_wipe(pool->buf, CHACHA20_KEY_SIZE);
+    pool->avail = CHACHA20_POOL_SIZE - CHACHA20_KEY_SIZE;
+}
+
+/**
+ * @brief Check if the pool must be reseeded before handing out more bytes.
+ *
+ * @param pool Pointer to the pool.
+ * @return int Returns 1 if the pool must be reseeded, 0 otherwise.
+ */
+static inline int chacha20_pool_needs_reseed(const chacha20_pool_t *pool)
+{
+    return !pool->seeded || pool->nread >= CHACHA20_POOL_RESEED_INTERVAL;
+}
+
+/**
+ * @brief Mix the seed into the key of the pool and rekey it.
+ *
+ * @param pool Pointer to the pool.
+ * @param seed Pointer to CHACHA20_KEY_SIZE bytes of seed material.
+ */
+static inline void chacha20_pool_reseed(chacha20_pool_t *pool,
+                                        const uint8_t *seed)
+{
+    for (int i = 0; i < 8; i++) {
+        pool->key[i] ^= chacha20_load32(seed + i * 4);
+    }
+    pool->seeded = 1;
+    pool->nread  = 0;
+    chacha20_pool_rekey(pool);
+}
+
+/**
+ * @brief Fill the buffer with random bytes from the pool.
+ *
+ * Requests larger than CHACHA20_POOL_SIZE are written directly from a
+ * separate keystream of the current key, which is rekeyed immediately after.
+ *
+ * @param pool Pointer to a seeded pool.
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ */
+static inline void chacha20_pool_fill(chacha20_pool_t *pool, void *buf,
+                                      size_t len)
+{
+    uint8_t *p = buf;
+
+    pool->nread += len;
+    if (len > CHACHA20_POOL_SIZE) {
+        chacha20_keystream(pool->key, 1, 0, p, len);
+        chacha20_pool_rekey(pool);
+        return;
+    }
+
+    while (len > 0) {
+        uint8_t *src = NULL;
+        size_t n     = 0;
+
+        if (pool->avail == 0) {
+            chacha20_pool_rekey(pool);
+        }
+        n   = (len < pool->avail) ? len : pool->avail;
+        src = pool->buf + CHACHA20_POOL_SIZE - pool->avail;
+        memcpy(p, src, n);
+        chacha20_wipe(src, n);
+        pool->avail -= n;
+        p += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief Derive a key from the seed of any length.
+ *
+ * The seed is absorbed in CHACHA20_KEY_SIZE bytes chunks; each zero-padded
+ * chunk is XORed into the key, and the key is replaced with the first
+ * CHACHA20_KEY_SIZE bytes of the block keyed by it, with the length of the
+ * seed as the nonce and the index of the chunk as the counter. The same seed
+ * always derives the same key, but it is not a password hash; the output is
+ * only as unpredictable as the seed.
+ *
+ * @param key Pointer to the CHACHA20_KEY_SIZE bytes buffer where the key will
+ * be stored.
+ * @param seed Pointer to the seed.
+ * @param len Number of bytes of the seed.
+ */
+static inline void chacha20_derive_key(uint8_t *key, const void *seed,
+                                       size_t len)
+{
+    const uint8_t *p = seed;
+    uint32_t k[8]    = {0};
+    uint8_t block[CHACHA20_BLOCK_SIZE];
+    uint64_t counter = 0;
+    size_t rest      = len;
+
+    // an empty seed is absorbed as a single zero chunk
+    do {
+        uint8_t chunk[CHACHA20_KEY_SIZE] = {0};
+        size_t n = (rest < sizeof(chunk)) ? rest : sizeof(chunk);
+
+        if (n) {
+            memcpy(chunk, p, n);
+        }
+        for (int i = 0; i < 8; i++) {
+            k[i] ^= chacha20_load32(chunk + i * 4);
+        }
+        chacha20_block(k, (uint64_t)len, counter++, block);
+        for (int i = 0; i < 8; i++) {
+            k[i] = chacha20_load32(block + i * 4);
+        }
+        chacha20_wipe(chunk, sizeof(chunk));
+        p += n;
+        rest -= n;
+    } while (rest > 0);
+
+    for (int i = 0; i < 8; i++) {
+        chacha20_store32(key + i * 4, k[i]);
+    }
+    chacha20_wipe(k, sizeof(k));
+    chacha20_wipe(block, sizeof(block));
+}
+
+/**
+ * @brief Mix the additional input into the seed.
+ *
+ * The seed and the input are hashed together by chacha20_derive_key() instead
+ * of being XORed, so an input chosen with the knowledge of the seed cannot
+ * cancel it; the result is at least as unpredictable as the seed alone.
+ *
+ * @param seed Pointer to CHACHA20_KEY_SIZE bytes of seed material, which is
+ * replaced with the mixed seed.
+ * @param extra Pointer to the additional input.
+ * @param len Number of bytes of the additional input, at most
+ * CHACHA20_KEY_SIZE.
+ */
+static inline void chacha20_mix_seed(uint8_t *seed, const void *extra,
+                                     size_t len)
+{
+    uint8_t buf[CHACHA20_KEY_SIZE * 2];
+
+    if (len > CHACHA20_KEY_SIZE) {
+        len = CHACHA20_KEY_SIZE;
+    }
+    memcpy(buf, seed, CHACHA20_KEY_SIZE);
+    memcpy(buf + CHACHA20_KEY_SIZE, extra, len);
+    chacha20_derive_key(seed, buf, CHACHA20_KEY_SIZE + len);
+    chacha20_wipe(buf, sizeof(buf));
+}
+
+/**
+ * @brief Wipe the whole state of the pool.
+ *
+ * @param pool Pointer to the pool.
+ */
+static inline void chacha20_pool_wipe(chacha20_pool_t *pool)
+{
+    chacha20_wipe(pool, sizeof(*pool));
+}
+
+#endif /* chacha20_h */
@@ -0,0 +1,197 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef encode_h
+#define encode_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define ENCODE_USE_SSE2 1
+# include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define ENCODE_USE_NEON 1
+# include <arm_neon.h>
+#endif
+
+typedef enum encode_type_e {
+    ENCODE_RAW = 0,
+    ENCODE_HEX,
+    ENCODE_BASE64,
+    ENCODE_BASE64URL,
+} encode_type_e;
+
+/**
+ * @brief Get the length of the encoded data.
+ *
+ * base64 is padded with '=', base64url is not padded.
+ *
+ * @param type Type of the encoding.
+ * @param len Number of bytes to be encoded.
+ * @return size_t Returns the number of encoded characters.
+ */
+static inline size_t encode_len(encode_type_e type, size_t len)
+{
+    switch (type) {
+    case ENCODE_HEX:
+        return len * 2;
+    case ENCODE_BASE64:
+        return (len + 2) / 3 * 4;
+    case ENCODE_BASE64URL:
+        return len / 3 * 4 + (len % 3 ? len % 3 + 1 : 0);
+    default:
+        return len;
+    }
+}
+
+/**
+ * @brief Encode the data as lowercase hexadecimal string.
+ *
+ * @param dst Pointer to the buffer of at least len * 2 bytes.
+ * @param src Pointer to the data to be encoded.
+ * @param len Number of bytes to be encoded.
+ */
+static inline void encode_hex(char *dst, const uint8_t *src, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+
+#if defined(ENCODE_USE_SSE2)
+    const __m128i mask  = _mm_set1_epi8(0x0f);
+    const __m128i nine  = _mm_set1_epi8(9);
+    const __m128i zero  = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+
+    for (; len >= 16; len -= 16, src += 16, dst += 32) {
+        __m128i v  = _mm_loadu_si128((const __m128i *)src);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+
+        // digit + '0' + (digit > 9 ? 'a' - '0' - 10 : 0)
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+                          _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+                          _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha));
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(ENCODE_USE_NEON)
+    const uint8x16_t mask  = vdupq_n_u8(0x0f);
+    const uint8x16_t nine  = vdupq_n_u8(9);
+    const uint8x16_t zero  = vdupq_n_u8('0');
+    const uint8x16_t alpha = vdupq_n_u8('a' - '0' - 10);
+
+    for (; len >= 16; len -= 16, src += 16, dst += 32) {
+        uint8x16_t v = vld1q_u8(src);
+        uint8x16x2_t out;
+
+        out.val[0] = vshrq_n_u8(v, 4);
+        out.val[1] = vandq_u8(v, mask);
+        // digit + '0' + (digit > 9 ? 'a' - '0' - 10 : 0)
+        out.val[0] = vaddq_u8(vaddq_u8(out.val[0], zero),
+                              vandq_u8(vcgtq_u8(out.val[0], nine), alpha));
+        out.val[1] = vaddq_u8(vaddq_u8(out.val[1], zero),
+                              vandq_u8(vcgtq_u8(out.val[1], nine), alpha));
+        vst2q_u8((uint8_t *)dst, out);
+    }
+#endif
+
+    for (size_t i = 0; i < len; i++) {
+        *dst++ = digits[src[i] >> 4];
+        *dst++ = digits[src[i] & 0x0f];
+    }
+}
+
+/**
+ * @brief Encode the data as base64 or base64url string.
+ *
+ * @param dst Pointer to the buffer of at least encode_len(type, len) bytes.
+ * @param src Pointer to the data to be encoded.
+ * @param len Number of bytes to be encoded.
+ * @param url Non-zero to use the base64url alphabet without padding.
+ */
+static inline void encode_base64(char *dst, const uint8_t *src, size_t len,
+                                 int url)
+{
+    static const char std_chars[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const char url_chars[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    const char *chars = url ? url_chars : std_chars;
+
+    for (; len >= 3; len -= 3, src += 3, dst += 4) {
+        uint32_t v = ((uint32_t)src[0] << 16) | ((uint32_t)src[1] << 8) |
+                     (uint32_t)src[2];
+        dst[0] = chars[v >> 18];
+        dst[1] = chars[(v >> 12) & 0x3f];
+        dst[2] = chars[(v >> 6) & 0x3f];
+        dst[3] = chars[v & 0x3f];
+    }
+
+    if (len) {
+        uint32_t v = (uint32_t)src[0] << 16;
+        if (len == 2) {
+            v |= (uint32_t)src[1] << 8;
+        }
+        *dst++ = chars[v >> 18];
+        *dst++ = chars[(v >> 12) & 0x3f];
+        if (len == 2) {
+            *dst++ = chars[(v >> 6) & 0x3f];
+        } else if (!url) {
+            *dst++ = '=';
+        }
+        if (!url) {
+            *dst = '=';
+        }
+    }
+}
+
+/**
+ * @brief Encode the data with the specified encoding.
+ *
+ * @param type Type of the encoding.
+ * @param dst Pointer to the buffer of at least encode_len(type, len) bytes.
+ * @param src Pointer to the data to be encoded.
+ * @param len Number of bytes to be encoded.
+ */
+static inline void encode(encode_type_e type, char *dst, const uint8_t *src,
+                          size_t len)
+{
+    switch (type) {
+    case ENCODE_HEX:
+        encode_hex(dst, src, len);
+        break;
+    case ENCODE_BASE64:
+        encode_base64(dst, src, len, 0);
+        break;
+    case ENCODE_BASE64URL:
+        encode_base64(dst, src, len, 1);
+        break;
+    default:
+        memcpy(dst, src, len);
+        break;
+    }
+}
+
+#endif /* encode_h */
@@ -0,0 +1,316 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef prefetch_h
+#define prefetch_h
+
+#if !defined(_WIN32)
+
+# include "chacha20.h"
+# include "secmem.h"
+# include "secrandom.h"
+# include "stats.h"
+# include <errno.h>
+# include <pthread.h>
+# include <stddef.h>
+# include <stdint.h>
+# include <string.h>
+# include <unistd.h>
+
+/**
+ * @brief Background producer of random blocks.
+ *
+ * A producer thread fills the blocks of a single-producer single-consumer
+ * ring, and the consumer pops them without taking a lock. the producer sleeps
+ * on the condition variable while the ring is full or after it has failed to
+ * generate a block, and the consumer takes the mutex to wake it only if it is
+ * parked.
+ */
+typedef struct {
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int stop;
+    int parked; // non-zero while the producer waits on the condition variable
+    // source of the blocks
+    const secrandom_backend_t *backend;       // for the seeds of the pool
+    const secrandom_backend_t *backend_block; // for the blocks read directly
+    int strict;                               // no fallback to the others
+    int fd_cached;
+    int pooled;
+    int hwrng;
+    chacha20_pool_t pool;
+    // counters of the producer, added to the instance counters by the owner
+    stats_t stats;
+    stats_shard_t *shards;
+    // ring of nblock blocks of bsize bytes
+    size_t bsize;
+    size_t nblock;
+    uint64_t head; // number of popped blocks, written by the consumer
+    uint64_t tail; // number of produced blocks, written by the producer
+    size_t size;   // number of bytes of the pages
+    unsigned char blocks[];
+} prefetch_t;
+
+// count the event of the producer in its own and the process-wide counters
+# define prefetch_stats_add(p, field, n)                                       \
+    do {                                                                       \
+        stats_atomic_add(&(p)->stats.field, (n));                              \
+        stats_atomic_add(&stats_shard((p)->shards)->field, (n));               \
+    } while (0)
+
+static inline int prefetch_read(prefetch_t *p, void *buf, size_t len,
+                                const secrandom_backend_t *b)
+{
+    const secrandom_backend_t *used = b;
+    uint64_t start                  = secrandom_clock_ns();
+    secrandom_result_e rc           = SECRANDOM_SUCCESS;
+
+    if (!p->strict) {
+        rc = secrandom_try(buf, len, &p->fd_cached, b, &used);
+    } else {
+        // use only the backend specified by the backend option
+        rc = b->func(buf, len, &p->fd_cached);
+    }
+
+    prefetch_stats_add(p, os_calls, 1);
+    prefetch_stats_add(p, os_ns, secrandom_clock_ns() - start);
+    if (rc != SECRANDOM_SUCCESS) {
+        prefetch_stats_add(p, os_errors, 1);
+        return -1;
+    } else if (used != b) {
+        int idx = secrandom_index(used);
+        if (idx >= 0 && idx < STATS_MAX_BACKENDS) {
+            prefetch_stats_add(p, fallbacks[idx], 1);
+        }
+    }
+    return 0;
+}
+
+static inline int prefetch_generate(prefetch_t *p, void *buf)
+{
+    if (!p->pooled) {
+        return prefetch_read(p, buf, p->bsize, p->backend_block);
+    } else if (chacha20_pool_needs_reseed(&p->pool)) {
+        uint8_t seed[CHACHA20_KEY_SIZE];
+        uint8_t hw[CHACHA20_KEY_SIZE];
+
+        if (prefetch_read(p, seed, sizeof(seed), p->backend) != 0) {
+            return -1;
+        }
+        // the hardware RNG is only an additional input as in the instance
+        if (p->hwrng && secrandom_hwrng(hw, sizeof(hw)) == SECRANDOM_SUCCESS) {
+            chacha20_mix_seed(seed, hw, sizeof(hw));
+        }
+        chacha20_wipe(hw, sizeof(hw));
+        chacha20_pool_reseed(&p->pool, seed);
+        chacha20_wipe(seed, sizeof(seed));
+        prefetch_stats_add(p, reseeds, 1);
+    }
+    chacha20_pool_fill(&p->pool, buf, p->bsize);
+    return 0;
+}
+
+static inline void *prefetch_thread(void *arg)
+{
+    prefetch_t *p = arg;
+
+    pthread_mutex_lock(&p->mutex);
+    while (!p->stop) {
+        uint64_t tail = p->tail;
+
+        if (tail - __atomic_load_n(&p->head, __ATOMIC_ACQUIRE) >= p->nblock) {
+            // publish that the producer is parked, and check the ring again;
+            // a block popped before the consumer sees the flag is found here
+            __atomic_store_n(&p->parked, 1, __ATOMIC_SEQ_CST);
+            if (tail - __atomic_load_n(&p->head, __ATOMIC_SEQ_CST) >=
+                p->nblock) {
+                // wait until the consumer pops a block
+                pthread_cond_wait(&p->cond, &p->mutex);
+            }
+            __atomic_store_n(&p->parked, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        pthread_mutex_unlock(&p->mutex);
+
+        if (prefetch_generate(p, p->blocks + (tail % p->nblock) * p->bsize) !=
+            0) {
+            // retry when the consumer finds the ring empty; it refills
+            // synchronously in the meantime and gets the error
+            pthread_mutex_lock(&p->mutex);
+            if (!p->stop) {
+                __atomic_store_n(&p->parked, 1, __ATOMIC_SEQ_CST);
+                pthread_cond_wait(&p->cond, &p->mutex);
+                __atomic_store_n(&p->parked, 0, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+        __atomic_store_n(&p->tail, tail + 1, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&p->mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+}
+
+/**
+ * @brief Start the producer thread.
+ *
+ * @param backend Backend to read the seed of the pool, or the blocks unless
+ * backend_large is specified, from.
+ * @param backend_large Backend to read the blocks from, or NULL.
+ * @param strict Non-zero to use only the specified backends without falling
+ * back to the others.
+ * @param pooled Non-zero to generate the blocks from a chacha20 pool.
+ * @param hwrng Non-zero to mix the hardware RNG into every seed of the pool.
+ * @param bsize Number of bytes of each block.
+ * @param nblock Number of blocks of the ring.
+ * @param flags Bitwise OR of SECMEM_* flags for the pages of the ring, in
+ * addition to SECMEM_WIPEONFORK.
+ * @param shards Process-wide counters where the producer counts its reads
+ * from the backend and the reseeds of the pool.
+ * @return prefetch_t* Returns the producer, or NULL with errno set on
+ * failure.
+ */
+static inline prefetch_t *prefetch_new(const secrandom_backend_t *backend,
+                                       const secrandom_backend_t *backend_large,
+                                       int strict, int pooled, int hwrng,
+                                       size_t bsize, size_t nblock, int flags,
+                                       stats_shard_t *shards)
+{
+    prefetch_t *p = NULL;
+    size_t size   = 0;
+    int rc        = 0;
+
+    if (bsize == 0 || nblock == 0 ||
+        nblock > (SIZE_MAX - sizeof(prefetch_t)) / bsize ||
+        (size = secmem_size(sizeof(prefetch_t) + bsize * nblock)) == 0) {
+        errno = ENOMEM;
+        return NULL;
+    } else if ((p = secmem_alloc(size, SECMEM_WIPEONFORK | flags)) == NULL) {
+        return NULL;
+    }
+    p->backend       = backend;
+    p->backend_block = backend_large ? backend_large : backend;
+    p->strict        = strict;
+    p->fd_cached     = -1;
+    p->pooled        = pooled;
+    p->hwrng         = hwrng;
+    p->shards        = shards;
+    p->bsize         = bsize;
+    p->nblock        = nblock;
+    p->size          = size;
+
+    if ((rc = pthread_mutex_init(&p->mutex, NULL)) != 0) {
+        goto FAIL;
+    } else if ((rc = pthread_cond_init(&p->cond, NULL)) != 0) {
+        pthread_mutex_destroy(&p->mutex);
+        goto FAIL;
+    } else if ((rc = pthread_create(&p->tid, NULL, prefetch_thread, p)) != 0) {
+        pthread_cond_destroy(&p->cond);
+        pthread_mutex_destroy(&p->mutex);
+        goto FAIL;
+    }
+    return p;
+
+FAIL:
+    secmem_free(p, size);
+    errno = rc;
+    return NULL;
+}
+
+/**
+ * @brief Pop a block from the ring.
+ *
+ * The consumer takes the mutex only to wake the producer if it is parked, so
+ * popping a block while the producer keeps up does not block.
+ *
+ * @param p Pointer to the producer.
+ * @param dst Pointer to the buffer of at least bsize bytes.
+ * @return int Returns 0 on success, or -1 if the ring is empty.
+ */
+static inline int prefetch_pop(prefetch_t *p, void *dst)
+{
+    uint64_t head        = p->head;
+    unsigned char *block = NULL;
+    int rc               = -1;
+
+    if (head != __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE)) {
+        block = p->blocks + (head % p->nblock) * p->bsize;
+        memcpy(dst, block, p->bsize);
+        chacha20_wipe(block, p->bsize);
+        __atomic_store_n(&p->head, head + 1, __ATOMIC_SEQ_CST);
+        rc = 0;
+    }
+
+    // wake the producer to refill the popped block, or to retry if it has
+    // failed to generate a block; it holds the mutex from publishing the flag
+    // until it waits, so the signal is not lost
+    if (__atomic_load_n(&p->parked, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&p->mutex);
+        pthread_cond_signal(&p->cond);
+        pthread_mutex_unlock(&p->mutex);
+    }
+    return rc;
+}
+
+/**
+ * @brief Stop the producer thread and release the ring.
+ *
+ * @param p Pointer to the producer.
+ */
+static inline void prefetch_free(prefetch_t *p)
+{
+    size_t size = p->size;
+
+    pthread_mutex_lock(&p->mutex);
+    p->stop = 1;
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->tid, NULL);
+
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    if (p->fd_cached != -1) {
+        close(p->fd_cached);
+    }
+    chacha20_wipe(p, size);
+    secmem_free(p, size);
+}
+
+/**
+ * @brief Release the ring in the child process after fork().
+ *
+ * The producer thread does not exist in the child process, so the ring is
+ * released without joining it.
+ *
+ * @param p Pointer to the producer of the parent process.
+ * @param size Number of bytes of the pages; the pages may have been wiped.
+ */
+static inline void prefetch_discard(prefetch_t *p, size_t size)
+{
+    secmem_free(p, size);
+}
+
+#endif /* !_WIN32 */
+
+#endif /* prefetch_h */
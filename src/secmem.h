@@ -0,0 +1,178 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef secmem_h
+#define secmem_h
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* zero-fill the pages in the child process after fork() */
+#define SECMEM_WIPEONFORK 0x1
+/* back the pages with transparent huge pages if possible */
+#define SECMEM_HUGEPAGE   0x2
+/* lock the pages in memory and exclude them from core dumps */
+#define SECMEM_LOCK       0x4
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+
+static inline size_t secmem_pagesize(void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (size_t)si.dwPageSize;
+}
+
+#else /* POSIX */
+# include <sys/mman.h>
+# include <unistd.h>
+
+# if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+
+static inline size_t secmem_pagesize(void)
+{
+    long size = sysconf(_SC_PAGESIZE);
+    return (size > 0) ? (size_t)size : 4096;
+}
+
+#endif /* POSIX */
+
+/**
+ * @brief Round up the size to a multiple of the page size.
+ *
+ * @param size Number of bytes.
+ * @return size_t Returns the rounded size, or 0 on overflow.
+ */
+static inline size_t secmem_size(size_t size)
+{
+    size_t pagesize = secmem_pagesize();
+
+    if (size > SIZE_MAX - pagesize) {
+        return 0;
+    }
+    return (size + pagesize - 1) / pagesize * pagesize;
+}
+
+/**
+ * @brief Allocate zero-filled pages that are not shared with other
+ * allocations.
+ *
+ * SECMEM_WIPEONFORK is advisory; it uses MADV_WIPEONFORK (Linux 4.14+) or
+ * minherit(INHERIT_ZERO) (OpenBSD / FreeBSD 12+) if they are available, so
+ * callers must still detect fork() on their own. SECMEM_HUGEPAGE is advisory
+ * as well; it uses MADV_HUGEPAGE (Linux) if it is available. SECMEM_LOCK is
+ * mandatory; it fails if mlock() (VirtualLock() on Windows) fails, e.g. by
+ * RLIMIT_MEMLOCK, and it uses MADV_DONTDUMP (Linux) or MADV_NOCORE (FreeBSD)
+ * if they are available.
+ *
+ * @param size Number of bytes to allocate. it must be the value returned by
+ * secmem_size().
+ * @param flags Bitwise OR of SECMEM_* flags.
+ * @return void* Returns the pointer to the pages, or NULL with errno set on
+ * failure.
+ */
+static inline void *secmem_alloc(size_t size, int flags)
+{
+    void *ptr = NULL;
+
+    if (size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+#if defined(_WIN32)
+    (void)flags; /* there is no fork() on Windows */
+    ptr = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (ptr == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if ((flags & SECMEM_LOCK) && !VirtualLock(ptr, size)) {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+#else /* POSIX */
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (flags & SECMEM_WIPEONFORK) {
+# if defined(MADV_WIPEONFORK)
+        (void)madvise(ptr, size, MADV_WIPEONFORK);
+# elif defined(INHERIT_ZERO)
+        (void)minherit(ptr, size, INHERIT_ZERO);
+# endif
+    }
+    if (flags & SECMEM_HUGEPAGE) {
+# if defined(MADV_HUGEPAGE)
+        (void)madvise(ptr, size, MADV_HUGEPAGE);
+# endif
+    }
+    if (flags & SECMEM_LOCK) {
+# if defined(MADV_DONTDUMP)
+        (void)madvise(ptr, size, MADV_DONTDUMP);
+# elif defined(MADV_NOCORE)
+        (void)madvise(ptr, size, MADV_NOCORE);
+# endif
+        if (mlock(ptr, size) != 0) {
+            int err = errno;
+            munmap(ptr, size);
+            errno = err;
+            return NULL;
+        }
+    }
+#endif /* POSIX */
+
+    return ptr;
+}
+
+/**
+ * @brief Release the pages allocated by secmem_alloc().
+ *
+ * the pages locked by SECMEM_LOCK are unlocked implicitly.
+ *
+ * @param ptr Pointer to the pages.
+ * @param size Number of bytes passed to secmem_alloc().
+ */
+static inline void secmem_free(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+#if defined(_WIN32)
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+#endif /* secmem_h */
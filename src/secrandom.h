@@ -26,6 +26,9 @@
 #include <errno.h>
 #include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 typedef enum secrandom_result_e {
     SECRANDOM_SUCCESS     = 0,
@@ -225,6 +228,349 @@ static inline secrandom_result_e secrandom_getentropy(void *buf, size_t len)
 
 #endif /* getentropy */
 
+#if defined(__linux__) && defined(__GLIBC__) && SECRANDOM_GLIBC_PREREQ(2, 25)
+/* getrandom (Linux 3.17+ with glibc 2.25+) */
+
+# include <sys/random.h>
+
+/* maximum number of bytes that getrandom returns at once */
+# define SECRANDOM_GETRANDOM_MAX 33554431
+
+/**
+ * @brief Generate secure random bytes using getrandom with the flags.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @param flags Flags passed to getrandom (e.g. GRND_NONBLOCK).
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * SECRANDOM_FAILURE on failure (errno is EAGAIN if GRND_NONBLOCK is specified
+ * and the kernel RNG is not initialized yet), or SECRANDOM_UNSUPPORTED if the
+ * kernel does not support getrandom.
+ */
+static inline secrandom_result_e secrandom_getrandom_ex(void *buf, size_t len,
+                                                        unsigned int flags)
+{
+    unsigned char *p = buf;
+    size_t left      = len;
+
+    if (buf == NULL) {
+        errno = EINVAL;
+        return SECRANDOM_FAILURE;
+    } else if (len == 0) {
+        return SECRANDOM_SUCCESS;
+    }
+
+    while (left > 0) {
+        size_t chunk =
+            left > SECRANDOM_GETRANDOM_MAX ? SECRANDOM_GETRANDOM_MAX : left;
+        ssize_t n = getrandom(p, chunk, flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                /* EINTR - retry */
+                continue;
+            } else if (errno == ENOSYS) {
+                /* kernel older than 3.17 */
+                return SECRANDOM_UNSUPPORTED;
+            }
+            return SECRANDOM_FAILURE;
+        }
+        /* getrandom may return fewer bytes than requested */
+        p += (size_t)n;
+        left -= (size_t)n;
+    }
+    return SECRANDOM_SUCCESS;
+}
+
+/**
+ * @brief Generate secure random bytes using getrandom.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * SECRANDOM_FAILURE on failure, or SECRANDOM_UNSUPPORTED if the kernel does
+ * not support getrandom.
+ */
+static inline secrandom_result_e secrandom_getrandom(void *buf, size_t len)
+{
+    return secrandom_getrandom_ex(buf, len, 0);
+}
+
+/**
+ * @brief Check if the kernel RNG has been initialized without blocking.
+ *
+ * @return int Returns 1 if it is initialized, 0 if it is not initialized yet,
+ * or -1 if it cannot be determined.
+ */
+static inline int secrandom_ready(void)
+{
+    unsigned char b = 0;
+
+    switch (secrandom_getrandom_ex(&b, sizeof(b), GRND_NONBLOCK)) {
+    case SECRANDOM_SUCCESS:
+        return 1;
+    case SECRANDOM_FAILURE:
+        return (errno == EAGAIN) ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+#else /* getrandom */
+
+/**
+ * @brief Generate secure random bytes using getrandom with the flags.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @param flags Flags passed to getrandom.
+ * @return secrandom_result_e Returns SECRANDOM_UNSUPPORTED as
+ * getrandom is not available.
+ */
+static inline secrandom_result_e secrandom_getrandom_ex(void *buf, size_t len,
+                                                        unsigned int flags)
+{
+    (void)buf;
+    (void)len;
+    (void)flags;
+    return SECRANDOM_UNSUPPORTED;
+}
+
+/**
+ * @brief Generate secure random bytes using getrandom.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_UNSUPPORTED as
+ * getrandom is not available.
+ */
+static inline secrandom_result_e secrandom_getrandom(void *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+    return SECRANDOM_UNSUPPORTED;
+}
+
+/**
+ * @brief Check if the kernel RNG has been initialized without blocking.
+ *
+ * @return int Returns -1 as it cannot be determined without getrandom.
+ */
+static inline int secrandom_ready(void)
+{
+    return -1;
+}
+
+#endif /* getrandom */
+
+#if !defined(SECRANDOM_NO_HWRNG) &&                                            \
+    (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+# include <cpuid.h>
+
+/* number of retries when the instruction has no random value available */
+# define SECRANDOM_HWRNG_RETRY 128
+
+/**
+ * @brief Detect RDSEED and RDRAND instructions by CPUID.
+ *
+ * @return int Returns 2 if RDSEED is available, 1 if only RDRAND is available,
+ * or 0 otherwise. the result is cached after the first call.
+ */
+static inline int secrandom_rdseed_available(void)
+{
+    static int available = -1;
+
+    if (available < 0) {
+        unsigned int a = 0, b = 0, c = 0, d = 0;
+
+        available = 0;
+        if (__get_cpuid(1, &a, &b, &c, &d) && (c & (1U << 30))) {
+            available = 1;
+        }
+        if (__get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, a, b, c, d);
+            if (b & (1U << 18)) {
+                available = 2;
+            }
+        }
+    }
+    return available;
+}
+
+static inline int secrandom_rdseed_step(int rdseed, unsigned long *v)
+{
+    unsigned char ok = 0;
+
+    for (int i = 0; i < SECRANDOM_HWRNG_RETRY; i++) {
+        if (rdseed) {
+            __asm__ __volatile__("rdseed %0; setc %1" : "=r"(*v), "=qm"(ok));
+        } else {
+            __asm__ __volatile__("rdrand %0; setc %1" : "=r"(*v), "=qm"(ok));
+        }
+        if (ok) {
+            return 1;
+        }
+        __asm__ __volatile__("pause");
+    }
+    return 0;
+}
+
+/**
+ * @brief Generate random bytes using RDSEED, or RDRAND if RDSEED is not
+ * available.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * SECRANDOM_FAILURE if the instruction keeps failing, or
+ * SECRANDOM_UNSUPPORTED if the CPU does not support them.
+ */
+static inline secrandom_result_e secrandom_rdseed(void *buf, size_t len)
+{
+    int available    = secrandom_rdseed_available();
+    unsigned char *p = buf;
+    unsigned long v  = 0;
+
+    if (!available) {
+        return SECRANDOM_UNSUPPORTED;
+    }
+    while (len > 0) {
+        size_t n = (len < sizeof(v)) ? len : sizeof(v);
+
+        if (!secrandom_rdseed_step(available == 2, &v)) {
+            return SECRANDOM_FAILURE;
+        }
+        memcpy(p, &v, n);
+        p += n;
+        len -= n;
+    }
+    return SECRANDOM_SUCCESS;
+}
+
+#else /* RDSEED */
+
+/**
+ * @brief Generate random bytes using RDSEED.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_UNSUPPORTED as
+ * RDSEED is not available.
+ */
+static inline secrandom_result_e secrandom_rdseed(void *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+    return SECRANDOM_UNSUPPORTED;
+}
+
+#endif /* RDSEED */
+
+#if !defined(SECRANDOM_NO_HWRNG) && defined(__aarch64__) &&                    \
+    defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+# include <sys/auxv.h>
+
+# if !defined(HWCAP2_RNG)
+#  define HWCAP2_RNG (1UL << 16)
+# endif
+
+/**
+ * @brief Detect the ARMv8.5-A RNDR instruction by HWCAP2.
+ *
+ * @return int Returns 1 if RNDR is available, or 0 otherwise. the result is
+ * cached after the first call.
+ */
+static inline int secrandom_rndr_available(void)
+{
+    static int available = -1;
+
+    if (available < 0) {
+        available = (getauxval(AT_HWCAP2) & HWCAP2_RNG) ? 1 : 0;
+    }
+    return available;
+}
+
+/**
+ * @brief Generate random bytes using RNDR.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * SECRANDOM_FAILURE if the instruction keeps failing, or
+ * SECRANDOM_UNSUPPORTED if the CPU does not support it.
+ */
+static inline secrandom_result_e secrandom_rndr(void *buf, size_t len)
+{
+    unsigned char *p = buf;
+    uint64_t v       = 0;
+
+    if (!secrandom_rndr_available()) {
+        return SECRANDOM_UNSUPPORTED;
+    }
+    while (len > 0) {
+        size_t n = (len < sizeof(v)) ? len : sizeof(v);
+        int ok   = 0;
+
+        for (int i = 0; i < 128 && !ok; i++) {
+            // RNDR clears the Z flag on success
+            __asm__ __volatile__("mrs %0, s3_3_c2_c4_0\n\tcset %w1, ne"
+                                 : "=r"(v), "=r"(ok)
+                                 :
+                                 : "cc");
+        }
+        if (!ok) {
+            return SECRANDOM_FAILURE;
+        }
+        memcpy(p, &v, n);
+        p += n;
+        len -= n;
+    }
+    return SECRANDOM_SUCCESS;
+}
+
+#else /* RNDR */
+
+/**
+ * @brief Generate random bytes using RNDR.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_UNSUPPORTED as
+ * RNDR is not available.
+ */
+static inline secrandom_result_e secrandom_rndr(void *buf, size_t len)
+{
+    (void)buf;
+    (void)len;
+    return SECRANDOM_UNSUPPORTED;
+}
+
+#endif /* RNDR */
+
+/**
+ * @brief Generate random bytes using the hardware RNG instruction of the CPU.
+ *
+ * This is not a backend of secrandom() and must not be used as the sole
+ * source of random bytes; it is meant to be mixed into the seed obtained
+ * from the operating system. it can be disabled by defining
+ * SECRANDOM_NO_HWRNG.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * SECRANDOM_FAILURE on failure, or SECRANDOM_UNSUPPORTED if the CPU has no
+ * supported instruction.
+ */
+static inline secrandom_result_e secrandom_hwrng(void *buf, size_t len)
+{
+    secrandom_result_e rc = secrandom_rdseed(buf, len);
+
+    if (rc == SECRANDOM_UNSUPPORTED) {
+        rc = secrandom_rndr(buf, len);
+    }
+    return rc;
+}
+
 #if defined(_WIN32) /* Windows (BCryptGenRandom) */
 
 /**
@@ -410,60 +756,165 @@ static inline secrandom_result_e secrandom_bcrypt(void *buf, size_t len)
 #endif /* _POSIX */
 
 /**
- * @brief Generate secure random bytes.
+ * @brief Signature of the functions that generate secure random bytes.
  *
  * @param buf Pointer to the buffer where random bytes will be stored.
  * @param len Number of bytes to generate.
  * @param fd_urandom Pointer to an integer for caching file descriptor for
  * /dev/urandom (if applicable).
+ */
+typedef secrandom_result_e (*secrandom_func_t)(void *buf, size_t len,
+                                               int *fd_urandom);
+
+typedef struct {
+    const char *name;
+    secrandom_func_t func;
+} secrandom_backend_t;
+
+static inline secrandom_result_e secrandom_backend_ossl(void *buf, size_t len,
+                                                        int *fd_urandom)
+{
+    (void)fd_urandom;
+    return secrandom_ossl(buf, len);
+}
+
+static inline secrandom_result_e
+secrandom_backend_arc4random(void *buf, size_t len, int *fd_urandom)
+{
+    (void)fd_urandom;
+    return secrandom_arc4random(buf, len);
+}
+
+static inline secrandom_result_e
+secrandom_backend_getrandom(void *buf, size_t len, int *fd_urandom)
+{
+    (void)fd_urandom;
+    return secrandom_getrandom(buf, len);
+}
+
+static inline secrandom_result_e
+secrandom_backend_getentropy(void *buf, size_t len, int *fd_urandom)
+{
+    (void)fd_urandom;
+    return secrandom_getentropy(buf, len);
+}
+
+static inline secrandom_result_e
+secrandom_backend_bcrypt(void *buf, size_t len, int *fd_urandom)
+{
+    (void)fd_urandom;
+    return secrandom_bcrypt(buf, len);
+}
+
+/**
+ * @brief Check if OpenSSL must be used as the primary source.
+ *
+ * @return int Returns non-zero in FIPS mode or if SECRANDOM_PREFER_OPENSSL is
+ * defined, or 0 otherwise.
+ */
+static inline int secrandom_ossl_mandatory(void)
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    return secrandom_ossl_fips_enabled() /* FIPS Provider / FIPS_mode() */
+# ifdef SECRANDOM_PREFER_OPENSSL
+           || 1 /* Prefer OpenSSL as primary source */
+# endif
+        ;
+#endif
+}
+
+/**
+ * @brief Get the list of backends in the order they should be tried.
+ *
+ * OpenSSL is placed first if it is mandatory (FIPS mode or
+ * SECRANDOM_PREFER_OPENSSL), otherwise it is used as the last fallback.
+ *
+ * @return const secrandom_backend_t* Returns the list terminated by an entry
+ * whose name is NULL.
+ */
+static inline const secrandom_backend_t *secrandom_backends(void)
+{
+#if defined(_WIN32)
+    /* On Windows, uses only BCryptGenRandom */
+    static const secrandom_backend_t backends[] = {
+        {"bcrypt", secrandom_backend_bcrypt},
+        {NULL,     NULL                    },
+    };
+    return backends;
+
+#else /* POSIX */
+    static const secrandom_backend_t ossl_first[] = {
+        {"openssl",    secrandom_backend_ossl      },
+        {"arc4random", secrandom_backend_arc4random},
+        {"getrandom",  secrandom_backend_getrandom },
+        {"getentropy", secrandom_backend_getentropy},
+        {"urandom",    secrandom_urandom_ex        },
+        {NULL,         NULL                        },
+    };
+    static const secrandom_backend_t ossl_last[] = {
+        {"arc4random", secrandom_backend_arc4random},
+        {"getrandom",  secrandom_backend_getrandom },
+        {"getentropy", secrandom_backend_getentropy},
+        {"urandom",    secrandom_urandom_ex        },
+        {"openssl",    secrandom_backend_ossl      },
+        {NULL,         NULL                        },
+    };
+
+    return secrandom_ossl_mandatory() ? ossl_first : ossl_last;
+#endif /* POSIX */
+}
+
+/**
+ * @brief Generate secure random bytes, trying the preferred backend first.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @param fd_urandom Pointer to an integer for caching file descriptor for
+ * /dev/urandom (if applicable).
+ * @param primary Backend to try first, or NULL to walk the whole list. If it
+ * fails, the remaining backends are tried in order.
+ * @param used Pointer to store the backend that generated the bytes, or NULL.
  * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
  * or SECRANDOM_FAILURE on failure, or SECRANDOM_UNSUPPORTED if
  * random generation is not supported on this platform.
  */
-static inline secrandom_result_e secrandom(void *buf, size_t len,
-                                           int *fd_urandom)
+static inline secrandom_result_e
+secrandom_try(void *buf, size_t len, int *fd_urandom,
+              const secrandom_backend_t *primary,
+              const secrandom_backend_t **used)
 {
-    secrandom_result_e rc = SECRANDOM_SUCCESS;
+    secrandom_result_e rc = SECRANDOM_UNSUPPORTED;
 
     if (buf == NULL) {
         errno = EINVAL;
         return SECRANDOM_FAILURE;
     } else if (len == 0) {
+        if (used) {
+            *used = primary;
+        }
         return SECRANDOM_SUCCESS;
     }
 
-#if defined(_WIN32)
-    /* On Windows, uses only BCryptGenRandom */
-    (void)fd_urandom; /* Unused parameter on Windows */
-    if ((rc = secrandom_bcrypt(buf, len)) == SECRANDOM_SUCCESS) {
-        return SECRANDOM_SUCCESS;
-    }
-
-#else /* POSIX */
-
-    const int ossl_mandatory =
-        secrandom_ossl_fips_enabled() /* FIPS Provider / FIPS_mode() */
-# ifdef SECRANDOM_PREFER_OPENSSL
-        || 1 /* Prefer OpenSSL as primary source */
-# endif
-        ;
-
-    if (ossl_mandatory &&
-        (rc = secrandom_ossl(buf, len)) == SECRANDOM_SUCCESS) {
-        return SECRANDOM_SUCCESS;
+    if (primary) {
+        if ((rc = primary->func(buf, len, fd_urandom)) == SECRANDOM_SUCCESS) {
+            if (used) {
+                *used = primary;
+            }
+            return SECRANDOM_SUCCESS;
+        }
     }
-    /* fallback to other methods if OpenSSL is not mandatory */
-
-    if ((rc = secrandom_arc4random(buf, len)) == SECRANDOM_SUCCESS ||
-        (rc = secrandom_getentropy(buf, len)) == SECRANDOM_SUCCESS ||
-        (rc = secrandom_urandom_ex(buf, len, fd_urandom)) ==
-            SECRANDOM_SUCCESS ||
-        /* use OpenSSL as fallback if not mandatory */
-        (ossl_mandatory == 0 &&
-         (rc = secrandom_ossl(buf, len)) == SECRANDOM_SUCCESS)) {
-        return SECRANDOM_SUCCESS;
+    /* fallback to other methods */
+    for (const secrandom_backend_t *b = secrandom_backends(); b->name; b++) {
+        if (b->func != (primary ? primary->func : NULL) &&
+            (rc = b->func(buf, len, fd_urandom)) == SECRANDOM_SUCCESS) {
+            if (used) {
+                *used = b;
+            }
+            return SECRANDOM_SUCCESS;
+        }
     }
-#endif /* POSIX */
 
     if (rc == SECRANDOM_UNSUPPORTED) {
         errno = ENOSYS; /* Function not implemented */
@@ -473,4 +924,183 @@ static inline secrandom_result_e secrandom(void *buf, size_t len,
     return rc;
 }
 
+/**
+ * @brief Generate secure random bytes, trying the preferred backend first.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @param fd_urandom Pointer to an integer for caching file descriptor for
+ * /dev/urandom (if applicable).
+ * @param primary Backend to try first, or NULL to walk the whole list. If it
+ * fails, the remaining backends are tried in order.
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * or SECRANDOM_FAILURE on failure, or SECRANDOM_UNSUPPORTED if
+ * random generation is not supported on this platform.
+ */
+static inline secrandom_result_e
+secrandom_ex(void *buf, size_t len, int *fd_urandom,
+             const secrandom_backend_t *primary)
+{
+    return secrandom_try(buf, len, fd_urandom, primary, NULL);
+}
+
+/**
+ * @brief Generate secure random bytes.
+ *
+ * @param buf Pointer to the buffer where random bytes will be stored.
+ * @param len Number of bytes to generate.
+ * @param fd_urandom Pointer to an integer for caching file descriptor for
+ * /dev/urandom (if applicable).
+ * @return secrandom_result_e Returns SECRANDOM_SUCCESS on success,
+ * or SECRANDOM_FAILURE on failure, or SECRANDOM_UNSUPPORTED if
+ * random generation is not supported on this platform.
+ */
+static inline secrandom_result_e secrandom(void *buf, size_t len,
+                                           int *fd_urandom)
+{
+    return secrandom_ex(buf, len, fd_urandom, NULL);
+}
+
+/**
+ * @brief Select the first backend that works on this system.
+ *
+ * The result can be cached and passed to secrandom_ex() to skip the
+ * FIPS mode check and the walk over unsupported backends on every call.
+ *
+ * @return const secrandom_backend_t* Returns the selected backend, or NULL
+ * if no backend works.
+ */
+static inline const secrandom_backend_t *secrandom_resolve(void)
+{
+    unsigned char probe[16];
+
+    for (const secrandom_backend_t *b = secrandom_backends(); b->name; b++) {
+        if (b->func(probe, sizeof(probe), NULL) == SECRANDOM_SUCCESS) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the backend by its name.
+ *
+ * @param name Name of the backend.
+ * @return const secrandom_backend_t* Returns the backend, or NULL if there is
+ * no backend with the name.
+ */
+static inline const secrandom_backend_t *secrandom_lookup(const char *name)
+{
+    for (const secrandom_backend_t *b = secrandom_backends(); b->name; b++) {
+        if (strcmp(b->name, name) == 0) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the index of the backend in the list of secrandom_backends().
+ *
+ * The backend is compared by its function, so the entries of the other lists
+ * are also found.
+ *
+ * @param b Pointer to the backend.
+ * @return int Returns the index, or -1 if the backend is not in the list.
+ */
+static inline int secrandom_index(const secrandom_backend_t *b)
+{
+    const secrandom_backend_t *backends = secrandom_backends();
+
+    for (int i = 0; b && backends[i].name; i++) {
+        if (backends[i].func == b->func) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if defined(_WIN32)
+static inline uint64_t secrandom_clock_ns(void)
+{
+    LARGE_INTEGER freq, now;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+#else
+# include <time.h>
+
+static inline uint64_t secrandom_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/**
+ * @brief Select the backend with the highest throughput for the size.
+ *
+ * Each backend that works on this system generates len bytes iter times, and
+ * the one that takes the shortest time is returned. if OpenSSL is mandatory
+ * (see secrandom_ossl_mandatory()), only OpenSSL is measured, so the result
+ * never bypasses it. the result should be cached by the caller since this
+ * takes a while.
+ *
+ * @param len Number of bytes of each call.
+ * @param iter Number of calls to measure.
+ * @return const secrandom_backend_t* Returns the fastest backend, or NULL if
+ * no backend works or the buffer cannot be allocated.
+ */
+static inline const secrandom_backend_t *secrandom_fastest(size_t len,
+                                                           int iter)
+{
+    const secrandom_backend_t *backends = secrandom_backends();
+    const secrandom_backend_t *fastest  = NULL;
+    uint64_t best                       = UINT64_MAX;
+    int ossl_only                       = secrandom_ossl_mandatory();
+    void *buf                           = malloc(len);
+
+    if (buf == NULL) {
+        return NULL;
+    }
+    for (const secrandom_backend_t *b = backends; b->name; b++) {
+        int fd           = -1;
+        uint64_t start   = 0;
+        uint64_t elapsed = 0;
+        int i            = 0;
+
+        // OpenSSL is the first entry of the list if it is mandatory
+        if (ossl_only && b != backends) {
+            break;
+        }
+        // warm up and skip the unsupported backend
+        if (b->func(buf, len, &fd) != SECRANDOM_SUCCESS) {
+            goto NEXT;
+        }
+        start = secrandom_clock_ns();
+        for (; i < iter; i++) {
+            if (b->func(buf, len, &fd) != SECRANDOM_SUCCESS) {
+                break;
+            }
+        }
+        elapsed = secrandom_clock_ns() - start;
+        if (i == iter && elapsed < best) {
+            best    = elapsed;
+            fastest = b;
+        }
+NEXT:
+#if !defined(_WIN32)
+        if (fd != -1) {
+            close(fd);
+        }
+#endif
+    }
+    free(buf);
+    return fastest;
+}
+
 #endif /* secrandom_h */
@@ -0,0 +1,214 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef stats_h
+#define stats_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * counters are updated without ordering guarantees; they are statistics.
+ * stats_atomic_add() returns the value before the addition.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+# define stats_atomic_add(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+# define stats_atomic_load(p)   __atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+# define stats_atomic_add(p, n) ((*(p) += (n)) - (n))
+# define stats_atomic_load(p)   (*(p))
+#endif
+
+/* storage class of the thread-local variables, or empty if not supported */
+#if defined(_MSC_VER)
+# define STATS_TLS __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+# define STATS_TLS __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&               \
+    !defined(__STDC_NO_THREADS__)
+# define STATS_TLS _Thread_local
+#else
+# define STATS_TLS
+#endif
+
+/* number of the shards of the process-wide counters */
+#define STATS_NSHARD    64
+/* assumed size of the cache line */
+#define STATS_CACHELINE 64
+
+/* maximum number of the backends returned by secrandom_backends() */
+#define STATS_MAX_BACKENDS 8
+
+typedef enum stats_method_e {
+    STATS_BYTES = 0,
+    STATS_FILL,
+    STATS_WRITE_TO,
+    STATS_TOKENS,
+    STATS_HEX,
+    STATS_BASE64,
+    STATS_BASE64URL,
+    STATS_UUID4,
+    STATS_UUID7,
+    STATS_ULID,
+    STATS_RANGE,
+    STATS_SHUFFLE,
+    STATS_PERMUTATION,
+    STATS_CHOICE,
+    STATS_WEIGHTED_CHOICE,
+    STATS_RESERVOIR,
+    STATS_GET8U,
+    STATS_GET16U,
+    STATS_GET32U,
+    STATS_GET64U,
+    STATS_GET8I,
+    STATS_GET16I,
+    STATS_GET32I,
+    STATS_GET64I,
+    STATS_U8,
+    STATS_U16,
+    STATS_U32,
+    STATS_U64,
+    STATS_I8,
+    STATS_I16,
+    STATS_I32,
+    STATS_I64,
+    STATS_DOUBLE,
+    STATS_FLOAT,
+    STATS_FFI_FILL,
+    STATS_NMETHOD,
+} stats_method_e;
+
+static const char *const STATS_METHOD_NAMES[STATS_NMETHOD] = {
+    [STATS_BYTES]           = "bytes",
+    [STATS_FILL]            = "fill",
+    [STATS_WRITE_TO]        = "write_to",
+    [STATS_TOKENS]          = "tokens",
+    [STATS_HEX]             = "hex",
+    [STATS_BASE64]          = "base64",
+    [STATS_BASE64URL]       = "base64url",
+    [STATS_UUID4]           = "uuid4",
+    [STATS_UUID7]           = "uuid7",
+    [STATS_ULID]            = "ulid",
+    [STATS_RANGE]           = "range",
+    [STATS_SHUFFLE]         = "shuffle",
+    [STATS_PERMUTATION]     = "permutation",
+    [STATS_CHOICE]          = "choice",
+    [STATS_WEIGHTED_CHOICE] = "weighted_choice",
+    [STATS_RESERVOIR]       = "reservoir",
+    [STATS_GET8U]           = "get8u",
+    [STATS_GET16U]          = "get16u",
+    [STATS_GET32U]          = "get32u",
+    [STATS_GET64U]          = "get64u",
+    [STATS_GET8I]           = "get8i",
+    [STATS_GET16I]          = "get16i",
+    [STATS_GET32I]          = "get32i",
+    [STATS_GET64I]          = "get64i",
+    [STATS_U8]              = "u8",
+    [STATS_U16]             = "u16",
+    [STATS_U32]             = "u32",
+    [STATS_U64]             = "u64",
+    [STATS_I8]              = "i8",
+    [STATS_I16]             = "i16",
+    [STATS_I32]             = "i32",
+    [STATS_I64]             = "i64",
+    [STATS_DOUBLE]          = "double",
+    [STATS_FLOAT]           = "float",
+    [STATS_FFI_FILL]        = "ffi_fill",
+};
+
+/**
+ * @brief Counters of the random number generation.
+ */
+typedef struct {
+    uint64_t calls[STATS_NMETHOD]; // number of calls per method
+    uint64_t bytes;                // number of random bytes produced
+    uint64_t os_calls;             // number of reads from the OS backends
+    uint64_t os_ns;                // nanoseconds spent in the OS backends
+    uint64_t os_errors;            // number of failed reads from the OS
+    uint64_t refills;              // number of refills of read-ahead buffer
+    uint64_t reseeds;              // number of reseeds of the pool
+    uint64_t grows;                // number of allocations of the buffer
+    // number of reads served by each backend after the preferred backend
+    // failed, indexed in the order of secrandom_backends()
+    uint64_t fallbacks[STATS_MAX_BACKENDS];
+} stats_t;
+
+/**
+ * @brief Shard of the process-wide counters.
+ *
+ * each shard is padded to the multiple of the cache line so that the threads
+ * updating the different shards never write to the same cache line.
+ */
+typedef union {
+    stats_t stats;
+    unsigned char pad[(sizeof(stats_t) + STATS_CACHELINE - 1) /
+                      STATS_CACHELINE * STATS_CACHELINE];
+} stats_shard_t;
+
+/**
+ * @brief Get the shard of the calling thread.
+ *
+ * the threads are assigned to the shards in a round-robin fashion on their
+ * first call. if there are more than STATS_NSHARD threads, some of them share
+ * a shard, which is still correct since the counters are updated atomically.
+ *
+ * @param shards Array of STATS_NSHARD shards.
+ * @return stats_t* Returns the counters of the shard.
+ */
+static inline stats_t *stats_shard(stats_shard_t *shards)
+{
+    static unsigned next          = 0;
+    // index of the shard plus one, or 0 if not assigned yet
+    static STATS_TLS unsigned idx = 0;
+
+    if (idx == 0) {
+        idx = (unsigned)stats_atomic_add(&next, 1) % STATS_NSHARD + 1;
+    }
+    return &shards[idx - 1].stats;
+}
+
+/**
+ * @brief Sum the counters of all shards.
+ *
+ * the sum is not a consistent snapshot while other threads are updating the
+ * counters, but each counter is read atomically.
+ *
+ * @param dst Pointer to the counters where the sum will be stored.
+ * @param shards Array of STATS_NSHARD shards.
+ */
+static inline void stats_sum(stats_t *dst, stats_shard_t *shards)
+{
+    // stats_t consists only of uint64_t counters
+    uint64_t *sum = (uint64_t *)dst;
+    size_t n      = sizeof(stats_t) / sizeof(uint64_t);
+
+    *dst = (stats_t){0};
+    for (int i = 0; i < STATS_NSHARD; i++) {
+        uint64_t *v = (uint64_t *)&shards[i].stats;
+        for (size_t j = 0; j < n; j++) {
+            sum[j] += stats_atomic_load(&v[j]);
+        }
+    }
+}
+
+#endif /* stats_h */
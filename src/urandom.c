@@ -22,7 +22,13 @@
  */
 
 // project
+#include "chacha20.h"
+#include "encode.h"
+#include "prefetch.h"
+#include "secmem.h"
 #include "secrandom.h"
+#include "stats.h"
+#include "uuid.h"
 // depend
 #include "lauxhlib.h"
 #include "lua_errno.h"
@@ -31,137 +37,2198 @@
 // system
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
+#if !defined(_WIN32)
+# include <fcntl.h>
+# include <pthread.h>
+#endif
 
 #define MODULE_MT "os.urandom"
+// metatable of the instance created with the seed option; its output is
+// reproducible and must not be used where the secure instance is expected
+#define SEEDED_MT "os.urandom.seeded"
+#define ALIAS_MT  "os.urandom.alias"
+#define BUFFER_MT "os.urandom.buffer"
+// registry key of the instance returned by urandom.shared()
+#define SHARED_KEY "os.urandom.shared"
+
+// backend selected by secrandom_resolve() when the module is loaded
+static const secrandom_backend_t *BACKEND = NULL;
+// non-zero if the hardware RNG of the CPU is detected when the module is
+// loaded
+static int HWRNG_AVAILABLE = 0;
+
+// non-zero once the kernel RNG is known to be initialized, and the file
+// descriptor of /dev/random returned by urandom.readyfd(). the threads with
+// their own lua_State may access them concurrently, so they are accessed only
+// by the atomic operations.
+static int RNG_READY = 0;
+static int READY_FD  = -1;
+
+#if defined(__GNUC__) || defined(__clang__)
+# define ready_load(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define ready_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+// replace *p with v if it is *expected, or store the current value to
+// *expected. returns non-zero if replaced.
+# define ready_cas(p, expected, v)                                             \
+    __atomic_compare_exchange_n((p), (expected), (v), 0, __ATOMIC_ACQ_REL,     \
+                                __ATOMIC_ACQUIRE)
+#elif defined(_MSC_VER)
+# define ready_load(p)     InterlockedCompareExchange((volatile LONG *)(p), 0, 0)
+# define ready_store(p, v) InterlockedExchange((volatile LONG *)(p), (v))
+#else
+# define ready_load(p)     (*(volatile int *)(p))
+# define ready_store(p, v) (*(volatile int *)(p) = (v))
+# define ready_cas(p, expected, v)                                             \
+    (*(p) == *(expected) ? (*(p) = (v), 1) : (*(expected) = *(p), 0))
+#endif
+
+// counters of all instances in this process, sharded by thread so that the
+// threads with their own lua_State do not contend on the same cache line
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((aligned(STATS_CACHELINE)))
+#endif
+static stats_shard_t STATS[STATS_NSHARD];
+
+// backends selected by the calibration of backend = "fastest"
+static int CALIBRATED                           = 0;
+static const secrandom_backend_t *FASTEST_SMALL = NULL;
+static const secrandom_backend_t *FASTEST_LARGE = NULL;
+
+#if !defined(_WIN32)
+// the process-wide state above is initialized only once even if the module
+// is used by several threads with their own lua_State
+static pthread_once_t INIT_ONCE      = PTHREAD_ONCE_INIT;
+static pthread_once_t CALIBRATE_ONCE = PTHREAD_ONCE_INIT;
+#endif
+
+// incremented in the child process by the pthread_atfork() handler
+static volatile uint64_t FORK_GENERATION = 0;
+
+#if !defined(_WIN32)
+// glibc unregisters the handler when the module is unloaded by dlclose()
+static void atfork_child(void)
+{
+    FORK_GENERATION++;
+}
+#endif
+
+/**
+ * state that must not be inherited by the child process.
+ * it is allocated in the pages that are wiped on fork() if possible.
+ */
+typedef struct {
+    // non-zero until the pages are wiped by fork()
+    uint64_t alive;
+    chacha20_pool_t pool;
+    // read-ahead buffer follows the header
+    char rbuf[];
+} urandom_state_t;
 
 typedef struct {
     int fd_cached; // cached file descriptor for /dev/urandom
     int ref_buf;
     size_t len;
+    // size of the pages if buf is allocated by secmem_alloc(), or 0 if buf is
+    // the userdata referenced by ref_buf
+    size_t mapped;
+    size_t mmap_threshold; // minimum size of buf allocated by secmem_alloc()
+    int mmap_flags;
+    // number of consecutive requests smaller than mmap_threshold since the
+    // last request that needed the buffer allocated by secmem_alloc()
+    size_t nsmall;
+    // buf and state are locked in memory, and buf is wiped after hand-out
+    int secure;
     union {
         uint8_t *i8;
         uint16_t *i16;
         uint32_t *i32;
+        uint64_t *i64;
         char *buf;
     };
+    const secrandom_backend_t *backend;
+    // backend for the reads of READ_LARGE_SIZE bytes or more, or NULL
+    const secrandom_backend_t *backend_large;
+    int strict; // do not fallback to the other backends
+    int nonblock; // fail with EAGAIN instead of blocking on early boot
+    int pooled;   // use the userspace chacha20 pool instead of secrandom()
+    int hwrng;  // mix the hardware RNG of the CPU into the seed of the pool
+    int seeded; // the pool is keyed by the seed option and never reseeded
+    // state of the pool and the read-ahead buffer
+    urandom_state_t *state;
+    size_t state_size;
+    uint64_t forkgen; // FORK_GENERATION when the state was initialized
+    char *rbuf;
+    size_t rsize; // size of rbuf, or 0 if read-ahead is disabled
+    size_t rpos;  // read cursor of rbuf; bytes before rpos are consumed
+#if !defined(_WIN32)
+    // background producer of the blocks of rbuf, or NULL
+    prefetch_t *prefetch;
+    size_t prefetch_size;
+#endif
+    stats_t stats;
 } urandom_t;
 
-static int read_urandom(lua_State *L, urandom_t *u, size_t nbyte,
-                        const char *op)
+// update the counter of the instance and the shard of the process-wide
+// counter of the calling thread
+#define stats_add(u, field, n)                                                 \
+    do {                                                                       \
+        (u)->stats.field += (n);                                               \
+        stats_atomic_add(&stats_shard(STATS)->field, (n));                     \
+    } while (0)
+
+/**
+ * return the instance at idx if it is created with or without the seed option,
+ * or NULL if it is not.
+ */
+static urandom_t *tourandom(lua_State *L, int idx)
+{
+    urandom_t *u = lua_touserdata(L, idx);
+
+    if (u && lua_getmetatable(L, idx)) {
+        int ok = 0;
+
+        luaL_getmetatable(L, MODULE_MT);
+        if (!(ok = lua_rawequal(L, -1, -2))) {
+            lua_pop(L, 1);
+            luaL_getmetatable(L, SEEDED_MT);
+            ok = lua_rawequal(L, -1, -2);
+        }
+        lua_pop(L, 2);
+        if (ok) {
+            return u;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * check if the value at idx is an instance created with or without the seed
+ * option, and return it. throws an error if it is not.
+ */
+static urandom_t *checkurandom(lua_State *L, int idx)
+{
+    urandom_t *u = tourandom(L, idx);
+
+    if (u) {
+        return u;
+    }
+    // throw an error with the standard message
+    return luaL_checkudata(L, idx, MODULE_MT);
+}
+
+/**
+ * overwrite the buffer with zeros in a way that is not optimized away.
+ */
+static inline void wipe(void *buf, size_t len)
+{
+#if (defined(__GLIBC__) && SECRANDOM_GLIBC_PREREQ(2, 25)) ||                   \
+    defined(__OpenBSD__) || defined(__FreeBSD__)
+    explicit_bzero(buf, len);
+#else
+    chacha20_wipe(buf, len);
+#endif
+}
+
+// minimum number of bytes to read from backend_large
+#define READ_LARGE_SIZE 4096
+
+static inline secrandom_result_e read_os(urandom_t *u, void *buf,
+                                         size_t nbyte)
+{
+    const secrandom_backend_t *b    = u->backend;
+    const secrandom_backend_t *used = NULL;
+    uint64_t start                  = secrandom_clock_ns();
+    secrandom_result_e rc           = SECRANDOM_SUCCESS;
+
+    if (u->backend_large && nbyte >= READ_LARGE_SIZE) {
+        b = u->backend_large;
+    }
+    if (!u->strict) {
+        rc = secrandom_try(buf, nbyte, &u->fd_cached, b, &used);
+    } else {
+        // use only the backend specified by the backend option
+        rc   = b->func(buf, nbyte, &u->fd_cached);
+        used = b;
+        if (rc == SECRANDOM_UNSUPPORTED) {
+            errno = ENOSYS;
+        } else if (rc != SECRANDOM_SUCCESS) {
+            errno = EIO;
+        }
+    }
+
+    stats_add(u, os_calls, 1);
+    stats_add(u, os_ns, secrandom_clock_ns() - start);
+    if (rc != SECRANDOM_SUCCESS) {
+        stats_add(u, os_errors, 1);
+    } else if (used != b) {
+        int idx = secrandom_index(used);
+        if (idx >= 0 && idx < STATS_MAX_BACKENDS) {
+            stats_add(u, fallbacks[idx], 1);
+        }
+    }
+    return rc;
+}
+
+static int fill_pool(urandom_t *u, void *buf, size_t nbyte)
+{
+    chacha20_pool_t *pool = &u->state->pool;
+
+    // the pool keyed by the seed option must keep its deterministic stream
+    if (!u->seeded && chacha20_pool_needs_reseed(pool)) {
+        uint8_t seed[CHACHA20_KEY_SIZE];
+        secrandom_result_e rc = read_os(u, seed, sizeof(seed));
+
+        if (rc == SECRANDOM_SUCCESS) {
+            uint8_t hw[CHACHA20_KEY_SIZE];
+
+            stats_add(u, reseeds, 1);
+            // the hardware RNG is only an additional input hashed with the
+            // seed from the operating system, which is used as is if it fails
+            if (u->hwrng &&
+                secrandom_hwrng(hw, sizeof(hw)) == SECRANDOM_SUCCESS) {
+                chacha20_mix_seed(seed, hw, sizeof(hw));
+            }
+            chacha20_wipe(hw, sizeof(hw));
+            chacha20_pool_reseed(pool, seed);
+        }
+        chacha20_wipe(seed, sizeof(seed));
+        if (rc != SECRANDOM_SUCCESS) {
+            return -1;
+        }
+    }
+    chacha20_pool_fill(pool, buf, nbyte);
+    return 0;
+}
+
+static int fill_source(urandom_t *u, void *buf, size_t nbyte)
+{
+    if (u->pooled) {
+        return fill_pool(u, buf, nbyte);
+    } else if (read_os(u, buf, nbyte) != SECRANDOM_SUCCESS) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * hand out the bytes from the read-ahead buffer and refill it in blocks.
+ * the bytes handed out are wiped from the buffer immediately.
+ */
+static int fill_buffered(urandom_t *u, void *buf, size_t nbyte)
+{
+    char *p = buf;
+
+    while (nbyte > 0) {
+        size_t n = 0;
+
+        if (u->rpos == u->rsize) {
+#if !defined(_WIN32)
+            // use the prefetched block if it is ready, or refill synchronously
+            if (!u->prefetch || prefetch_pop(u->prefetch, u->rbuf) != 0)
+#endif
+            {
+                if (fill_source(u, u->rbuf, u->rsize) != 0) {
+                    return -1;
+                }
+            }
+            stats_add(u, refills, 1);
+            u->rpos = 0;
+        }
+        n = u->rsize - u->rpos;
+        if (n > nbyte) {
+            n = nbyte;
+        }
+        memcpy(p, u->rbuf + u->rpos, n);
+        wipe(u->rbuf + u->rpos, n);
+        u->rpos += n;
+        p += n;
+        nbyte -= n;
+    }
+    return 0;
+}
+
+/**
+ * discard the pool and the read-ahead buffer if the process has been forked
+ * after they were initialized, so the child never hands out the same bytes
+ * as the parent. the wiped pool is reseeded on the next use.
+ * the state of the seeded instance is not wiped on fork(), and the child
+ * continues the same stream as the parent.
+ */
+static inline void check_fork(urandom_t *u)
+{
+    urandom_state_t *state = u->state;
+
+    if (state && !u->seeded &&
+        (!state->alive || u->forkgen != FORK_GENERATION)) {
+        wipe(state, u->state_size);
+        state->alive = 1;
+        u->forkgen   = FORK_GENERATION;
+        u->rpos      = u->rsize;
+#if !defined(_WIN32)
+        if (u->prefetch) {
+            // the producer thread does not exist in the child process
+            prefetch_discard(u->prefetch, u->prefetch_size);
+            u->prefetch = NULL;
+        }
+#endif
+    }
+}
+
+/**
+ * check if the kernel RNG is initialized so that reading from it does not
+ * block. returns 0 if it is, or -1 with errno set to EAGAIN otherwise.
+ * if it cannot be determined, it is considered initialized.
+ */
+static int check_ready(void)
+{
+    if (!ready_load(&RNG_READY)) {
+        if (secrandom_ready() == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        // the kernel RNG never gets uninitialized once initialized
+        ready_store(&RNG_READY, 1);
+    }
+    return 0;
+}
+
+/**
+ * fill the buffer with random bytes from the source of the instance without
+ * counting them as the produced bytes. this is used directly only for the key
+ * material that is not handed out. returns 0 on success, or -1 with errno set
+ * on failure.
+ */
+static int fill_uncounted(urandom_t *u, void *buf, size_t nbyte)
+{
+    if (nbyte == 0) {
+        return 0;
+    } else if (u->nonblock && check_ready() != 0) {
+        return -1;
+    }
+    check_fork(u);
+    if (nbyte < u->rsize) {
+        return fill_buffered(u, buf, nbyte);
+    }
+    // large requests bypass the read-ahead buffer
+    return fill_source(u, buf, nbyte);
+}
+
+/**
+ * fill the buffer with random bytes from the source of the instance.
+ * returns 0 on success, or -1 with errno set on failure.
+ */
+static int fill_random(urandom_t *u, void *buf, size_t nbyte)
+{
+    int rc = fill_uncounted(u, buf, nbyte);
+
+    if (rc == 0) {
+        stats_add(u, bytes, nbyte);
+    }
+    return rc;
+}
+
+/**
+ * release the internal buffer. it is wiped first in secure mode.
+ */
+static void release_buf(lua_State *L, urandom_t *u)
+{
+    if (u->secure && u->buf) {
+        wipe(u->buf, u->len);
+    }
+    if (u->mapped) {
+        secmem_free(u->buf, u->mapped);
+        u->mapped = 0;
+    } else {
+        u->ref_buf = lauxh_unref(L, u->ref_buf);
+    }
+    u->buf = NULL;
+    u->len = 0;
+}
+
+/**
+ * wipe the first nbyte bytes of the buffer that have been handed out if the
+ * instance is in secure mode.
+ */
+static inline void wipe_buf(urandom_t *u, size_t nbyte)
+{
+    if (u->secure && u->buf) {
+        wipe(u->buf, (nbyte < u->len) ? nbyte : u->len);
+    }
+}
+
+// number of consecutive small requests after which the large buffer is
+// released
+#define MMAP_DECAY_CALLS 64
+
+/**
+ * grow the internal buffer to at least nbyte bytes. returns 0 on success, or
+ * -1 with errno set if the secure buffer cannot be allocated.
+ */
+static int reserve_buf(lua_State *L, urandom_t *u, size_t nbyte)
+{
+    if (!u->mapped || nbyte >= u->mmap_threshold) {
+        u->nsmall = 0;
+    } else if (++u->nsmall >= MMAP_DECAY_CALLS) {
+        // return the pages of the large buffer once the requests have been
+        // smaller for a while, so alternating sizes do not remap every call
+        release_buf(L, u);
+        u->nsmall = 0;
+    }
+
+    if (nbyte > u->len) {
+        // allocate a new buffer and release the old one
+        release_buf(L, u);
+        stats_add(u, grows, 1);
+        if (u->mmap_threshold && nbyte >= u->mmap_threshold) {
+            // large buffer is allocated outside of the GC heap
+            size_t size = secmem_size(nbyte);
+            void *ptr   = size ? secmem_alloc(size, u->mmap_flags) : NULL;
+            if (ptr) {
+                u->buf    = ptr;
+                u->len    = size;
+                u->mapped = size;
+                return 0;
+            } else if (u->secure) {
+                // secure buffer must not fallback to the GC memory
+                if (size == 0) {
+                    errno = ENOMEM;
+                }
+                return -1;
+            }
+            // fallback to the userdata
+        }
+        u->buf     = lua_newuserdata(L, nbyte);
+        u->len     = nbyte;
+        u->ref_buf = lauxh_ref(L);
+    }
+    return 0;
+}
+
+static int read_urandom(lua_State *L, urandom_t *u, size_t nbyte,
+                        const char *op)
+{
+    if (reserve_buf(L, u, nbyte) != 0 || fill_random(u, u->buf, nbyte) != 0) {
+        // secrandom failed
+        lua_pushnil(L);
+        lua_errno_new(L, errno, op);
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * push the field k of the options table at idx if it is not nil, and check its
+ * type. returns 0 if the field is nil.
+ */
+static int checkopt(lua_State *L, int idx, const char *k, int type)
+{
+    lua_getfield(L, idx, k);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return 0;
+    } else if (lua_type(L, -1) != type) {
+        return luaL_argerror(L, idx,
+                             lua_pushfstring(L, "%s: %s expected, got %s", k,
+                                             lua_typename(L, type),
+                                             luaL_typename(L, -1)));
+    }
+    return 1;
+}
+
+/**
+ * get the field k of the options table at idx as a non-negative integer.
+ */
+static size_t optsize(lua_State *L, int idx, const char *k, size_t def)
+{
+    if (checkopt(L, idx, k, LUA_TNUMBER)) {
+        lua_Integer v = lua_tointeger(L, -1);
+        if (v < 0 || (lua_Number)v != lua_tonumber(L, -1)) {
+            lua_pushfstring(L, "%s: non-negative integer expected", k);
+            return luaL_argerror(L, idx, lua_tostring(L, -1));
+        }
+        lua_pop(L, 1);
+        return (size_t)v;
+    }
+    return def;
+}
+
+#if defined(_WIN32)
+# define fill_parallel(u, buf, nbyte, nthread) fill_random(u, buf, nbyte)
+#else
+// minimum number of bytes that each thread generates
+# define PARALLEL_MIN_SIZE    (1024 * 1024)
+# define PARALLEL_MAX_THREADS 64
+
+typedef struct {
+    const uint32_t *key;
+    uint64_t counter; // block counter of the first block
+    char *buf;
+    size_t len;
+} parallel_job_t;
+
+static void *parallel_worker(void *arg)
+{
+    parallel_job_t *job = arg;
+    chacha20_keystream(job->key, 0, job->counter, job->buf, job->len);
+    return NULL;
+}
+
+/**
+ * fill the large buffer in parallel. each thread writes a disjoint region
+ * from an independent block counter range of the keystream of a one-time key
+ * obtained from the source of the instance.
+ */
+static int fill_parallel(urandom_t *u, void *buf, size_t nbyte, size_t nthread)
+{
+    uint8_t seed[CHACHA20_KEY_SIZE];
+    uint32_t key[8];
+    parallel_job_t jobs[PARALLEL_MAX_THREADS];
+    pthread_t tids[PARALLEL_MAX_THREADS];
+    int started[PARALLEL_MAX_THREADS] = {0};
+    size_t chunk                      = 0;
+
+    if (nthread > nbyte / PARALLEL_MIN_SIZE) {
+        nthread = nbyte / PARALLEL_MIN_SIZE;
+    }
+    if (nthread > PARALLEL_MAX_THREADS) {
+        nthread = PARALLEL_MAX_THREADS;
+    }
+    if (nthread < 2) {
+        return fill_random(u, buf, nbyte);
+    }
+
+    // the one-time key is not handed out, so only nbyte bytes are counted
+    if (fill_uncounted(u, seed, sizeof(seed)) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 8; i++) {
+        key[i] = chacha20_load32(seed + i * 4);
+    }
+    wipe(seed, sizeof(seed));
+
+    stats_add(u, bytes, nbyte);
+    // split the buffer at the block boundaries. since each thread generates at
+    // least PARALLEL_MIN_SIZE bytes, the last region is never empty.
+    chunk = (nbyte / nthread + CHACHA20_BLOCK_SIZE - 1) / CHACHA20_BLOCK_SIZE *
+            CHACHA20_BLOCK_SIZE;
+    for (size_t i = 0; i < nthread; i++) {
+        size_t offset = i * chunk;
+        size_t len    = (nbyte - offset < chunk) ? nbyte - offset : chunk;
+
+        jobs[i] = (parallel_job_t){
+            .key     = key,
+            .counter = offset / CHACHA20_BLOCK_SIZE,
+            .buf     = (char *)buf + offset,
+            .len     = len,
+        };
+    }
+    for (size_t i = 1; i < nthread; i++) {
+        if (pthread_create(&tids[i], NULL, parallel_worker, &jobs[i]) == 0) {
+            started[i] = 1;
+        } else {
+            // generate in this thread if failed to create a thread
+            parallel_worker(&jobs[i]);
+        }
+    }
+    parallel_worker(&jobs[0]);
+    for (size_t i = 1; i < nthread; i++) {
+        if (started[i]) {
+            pthread_join(tids[i], NULL);
+        }
+    }
+    wipe(key, sizeof(key));
+    return 0;
+}
+#endif
+
+/**
+ * options of the methods that fill the random bytes.
+ */
+typedef struct {
+    size_t threads;
+    int nonblock;
+} callopts_t;
+
+static void check_callopts(lua_State *L, int idx, callopts_t *opts)
+{
+    *opts = (callopts_t){
+        .threads = 1,
+    };
+    if (!lua_isnoneornil(L, idx)) {
+        luaL_checktype(L, idx, LUA_TTABLE);
+        opts->threads = optsize(L, idx, "threads", 1);
+        if (checkopt(L, idx, "nonblock", LUA_TBOOLEAN)) {
+            opts->nonblock = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+        }
+    }
+}
+
+static int fill_with(urandom_t *u, void *buf, size_t nbyte,
+                     const callopts_t *opts)
+{
+    if (opts->nonblock && nbyte > 0 && check_ready() != 0) {
+        return -1;
+    } else if (opts->threads > 1) {
+        return fill_parallel(u, buf, nbyte, opts->threads);
+    }
+    return fill_random(u, buf, nbyte);
+}
+
+/**
+ * load the random words as little-endian, so the seeded instance returns the
+ * same values on the hosts of any byte order. the compilers turn them into a
+ * plain load on the little-endian hosts.
+ */
+static inline uint16_t load16le(const void *p)
+{
+    const uint8_t *b = p;
+    return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+static inline uint32_t load32le(const void *p)
+{
+    return chacha20_load32(p);
+}
+
+static inline uint64_t load64le(const void *p)
+{
+    const uint8_t *b = p;
+    return (uint64_t)chacha20_load32(b) |
+           ((uint64_t)chacha20_load32(b + 4) << 32);
+}
+
+// number of bytes to read when the random words run out
+#define WORDS_REFILL_SIZE 256
+
+/**
+ * reader of random words from the internal buffer.
+ * the buffer is refilled only when all words are consumed.
+ */
+typedef struct {
+    urandom_t *u;
+    const char *op;
+    size_t pos; // read position in u->buf
+    size_t len; // number of random bytes in u->buf
+    size_t max; // maximum number of random bytes filled into u->buf
+} urandom_words_t;
+
+static int words_fill(lua_State *L, urandom_words_t *w, size_t nbyte)
+{
+    int rc = read_urandom(L, w->u, nbyte, w->op);
+
+    if (rc == 0) {
+        w->pos = 0;
+        w->len = nbyte;
+        if (nbyte > w->max) {
+            w->max = nbyte;
+        }
+    }
+    return rc;
+}
+
+static inline void words_wipe(urandom_words_t *w)
+{
+    wipe_buf(w->u, w->max);
+}
+
+/**
+ * get the next word of size bytes, which is sizeof(uint32_t) or
+ * sizeof(uint64_t).
+ */
+static inline int words_next(lua_State *L, urandom_words_t *w, void *v,
+                             size_t size)
+{
+    const char *p = NULL;
+
+    if (w->len - w->pos < size) {
+        int rc = words_fill(L, w, WORDS_REFILL_SIZE);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    p = w->u->buf + w->pos;
+    if (size == sizeof(uint32_t)) {
+        *(uint32_t *)v = load32le(p);
+    } else {
+        *(uint64_t *)v = load64le(p);
+    }
+    w->pos += size;
+    return 0;
+}
+
+static inline uint64_t mul64(uint64_t a, uint64_t b, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t m = (__uint128_t)a * b;
+    *lo           = (uint64_t)m;
+    return (uint64_t)(m >> 64);
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+    uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+
+    *lo = (mid << 32) | (uint32_t)p0;
+    return p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+}
+
+/**
+ * get an unbiased random integer in [0, n) by Lemire's multiply-shift
+ * method with rejection. n == 0 means 2^64.
+ */
+static int words_bounded(lua_State *L, urandom_words_t *w, uint64_t n,
+                         uint64_t *v)
+{
+    int rc = 0;
+
+    if (n == 0) {
+        // full 64-bit range
+        return words_next(L, w, v, sizeof(uint64_t));
+    } else if (n <= UINT32_MAX) {
+        uint32_t x = 0;
+        uint64_t m = 0;
+
+        if ((rc = words_next(L, w, &x, sizeof(x))) != 0) {
+            return rc;
+        }
+        m = (uint64_t)x * n;
+        if ((uint32_t)m < n) {
+            uint32_t t = (uint32_t)(-(uint32_t)n) % (uint32_t)n;
+            while ((uint32_t)m < t) {
+                if ((rc = words_next(L, w, &x, sizeof(x))) != 0) {
+                    return rc;
+                }
+                m = (uint64_t)x * n;
+            }
+        }
+        *v = m >> 32;
+    } else {
+        uint64_t x  = 0;
+        uint64_t lo = 0;
+        uint64_t hi = 0;
+
+        if ((rc = words_next(L, w, &x, sizeof(x))) != 0) {
+            return rc;
+        }
+        hi = mul64(x, n, &lo);
+        if (lo < n) {
+            uint64_t t = -n % n;
+            while (lo < t) {
+                if ((rc = words_next(L, w, &x, sizeof(x))) != 0) {
+                    return rc;
+                }
+                hi = mul64(x, n, &lo);
+            }
+        }
+        *v = hi;
+    }
+    return 0;
+}
+
+#if LUA_VERSION_NUM >= 503
+# define push64u(L, v)        lua_pushinteger(L, (lua_Integer)(v))
+# define push64i(L, v)        lua_pushinteger(L, (lua_Integer)(v))
+# define push64u2arr(L, i, v) lauxh_pushint2arr(L, i, (lua_Integer)(v))
+# define push64i2arr(L, i, v) lauxh_pushint2arr(L, i, (lua_Integer)(v))
+#else
+// without 64-bit integers, the values are reduced to the range that can be
+// represented exactly as a double; [0, 2^53) and [-2^53, 2^53).
+# define u64tonum(v) ((lua_Number)((uint64_t)(v) >> 11))
+# define i64tonum(v)                                                           \
+    ((lua_Number)((int64_t)((uint64_t)(v) >> 10) - ((int64_t)1 << 53)))
+# define push64u(L, v)        lua_pushnumber(L, u64tonum(v))
+# define push64i(L, v)        lua_pushnumber(L, i64tonum(v))
+# define push64u2arr(L, i, v) lauxh_pushnum2arr(L, i, u64tonum(v))
+# define push64i2arr(L, i, v) lauxh_pushnum2arr(L, i, i64tonum(v))
+#endif
+
+/**
+ * check the optional destination table at idx and the offset at idx + 1.
+ * returns the offset of the elements to be stored.
+ */
+static size_t check_dsttbl(lua_State *L, int idx)
+{
+    lua_Integer offset = 0;
+
+    if (!lua_isnoneornil(L, idx)) {
+        luaL_checktype(L, idx, LUA_TTABLE);
+        offset = luaL_optinteger(L, idx + 1, 0);
+        luaL_argcheck(L, offset >= 0, idx + 1,
+                      "offset must be greater than or equal to 0");
+    }
+    return (size_t)offset;
+}
+
+/**
+ * push the destination table at idx, or a new table for count elements to
+ * the top of the stack.
+ */
+static void push_dsttbl(lua_State *L, int idx, size_t count)
+{
+    if (lua_isnoneornil(L, idx)) {
+        lua_settop(L, 1);
+        lua_createtable(L, count, 0);
+    } else {
+        lua_settop(L, idx);
+    }
+}
+
+static inline int getu_lua(lua_State *L, stats_method_e m, const char *op,
+                           int nbit, int sign)
+{
+    urandom_t *u      = checkurandom(L, 1);
+    size_t count      = (size_t)lauxh_checkpint(L, 2);
+    size_t offset     = check_dsttbl(L, 3);
+    size_t bytes_elem = nbit / 8;
+    int rc            = 0;
+
+    stats_add(u, calls[m], 1);
+    // check for overflow before multiplication
+    // also check if count is too large for lua_createtable's narr parameter
+    if (count > (SIZE_MAX / bytes_elem) || count > INT_MAX ||
+        offset > INT_MAX - count) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, op);
+        return 2;
+    }
+
+    rc = read_urandom(L, u, count * bytes_elem, op);
+    if (rc != 0) {
+        // read error
+        return rc;
+    }
+
+    push_dsttbl(L, 3, count);
+
+#define load8(p) (*(const uint8_t *)(p))
+#define push_ival(t, load, pushfn)                                             \
+    do {                                                                       \
+        const char *p = u->buf;                                                \
+        for (size_t i = 1; i <= count; i++) {                                  \
+            pushfn(L, offset + i, (t)load(p));                                 \
+            p += sizeof(t);                                                    \
+        }                                                                      \
+    } while (0)
+
+    if (nbit == 8) {
+        if (sign) {
+            push_ival(int8_t, load8, lauxh_pushint2arr);
+        } else {
+            push_ival(uint8_t, load8, lauxh_pushint2arr);
+        }
+    } else if (nbit == 16) {
+        if (sign) {
+            push_ival(int16_t, load16le, lauxh_pushint2arr);
+        } else {
+            push_ival(uint16_t, load16le, lauxh_pushint2arr);
+        }
+    } else if (nbit == 32) {
+        if (sign) {
+            push_ival(int32_t, load32le, lauxh_pushint2arr);
+        } else {
+            push_ival(uint32_t, load32le, lauxh_pushint2arr);
+        }
+    } else if (nbit == 64) {
+        if (sign) {
+            push_ival(uint64_t, load64le, push64i2arr);
+        } else {
+            push_ival(uint64_t, load64le, push64u2arr);
+        }
+    }
+    wipe_buf(u, count * bytes_elem);
+
+#undef push_ival
+#undef load8
+
+    return 1;
+}
+
+/**
+ * get a single integer without creating a table. the value is written
+ * directly into a local variable, so if the instance serves bytes from the
+ * userspace pool, no system call is made.
+ */
+static inline int getv_lua(lua_State *L, stats_method_e m, const char *op,
+                           int nbit, int sign)
+{
+    urandom_t *u = checkurandom(L, 1);
+    uint8_t v[8] = {0};
+
+    stats_add(u, calls[m], 1);
+    if (fill_random(u, v, nbit / 8) != 0) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, op);
+        return 2;
+    }
+
+    if (nbit == 8) {
+        lua_pushinteger(L, sign ? (lua_Integer)(int8_t)v[0] : v[0]);
+    } else if (nbit == 16) {
+        uint16_t x = load16le(v);
+        lua_pushinteger(L, sign ? (lua_Integer)(int16_t)x : x);
+    } else if (nbit == 32) {
+        uint32_t x = load32le(v);
+        lua_pushinteger(L, sign ? (lua_Integer)(int32_t)x : x);
+    } else if (sign) {
+        push64i(L, load64le(v));
+    } else {
+        push64u(L, load64le(v));
+    }
+    if (u->secure) {
+        wipe(&v, sizeof(v));
+    }
+    return 1;
+}
+
+static int u8_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_U8, "os.urandom.u8", 8, 0);
+}
+
+static int u16_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_U16, "os.urandom.u16", 16, 0);
+}
+
+static int u32_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_U32, "os.urandom.u32", 32, 0);
+}
+
+static int u64_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_U64, "os.urandom.u64", 64, 0);
+}
+
+static int i8_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_I8, "os.urandom.i8", 8, 1);
+}
+
+static int i16_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_I16, "os.urandom.i16", 16, 1);
+}
+
+static int i32_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_I32, "os.urandom.i32", 32, 1);
+}
+
+static int i64_lua(lua_State *L)
+{
+    return getv_lua(L, STATS_I64, "os.urandom.i64", 64, 1);
+}
+
+static int get64u_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET64U, "os.urandom.get64u", 64, 0);
+}
+
+static int get32u_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET32U, "os.urandom.get32u", 32, 0);
+}
+
+static int get16u_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET16U, "os.urandom.get16u", 16, 0);
+}
+
+static int get8u_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET8U, "os.urandom.get8u", 8, 0);
+}
+
+static int get64i_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET64I, "os.urandom.get64i", 64, 1);
+}
+
+static int get32i_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET32I, "os.urandom.get32i", 32, 1);
+}
+
+static int get16i_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET16I, "os.urandom.get16i", 16, 1);
+}
+
+static int get8i_lua(lua_State *L)
+{
+    return getu_lua(L, STATS_GET8I, "os.urandom.get8i", 8, 1);
+}
+
+/**
+ * convert the random words in the buffer into uniform floating-point numbers
+ * in [0, 1) in place. the loop has no dependency between the elements so that
+ * the compiler can vectorize it.
+ */
+static inline void words2double(char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t x = load64le(buf + i * sizeof(x));
+        double v   = 0;
+
+        // use the upper 53 bits as the mantissa
+        v = (double)(x >> 11) * 0x1.0p-53;
+        memcpy(buf + i * sizeof(v), &v, sizeof(v));
+    }
+}
+
+static inline void words2float(char *buf, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint32_t x = load32le(buf + i * sizeof(x));
+        float v    = 0;
+
+        // use the upper 24 bits as the mantissa
+        v = (float)(x >> 8) * 0x1.0p-24f;
+        memcpy(buf + i * sizeof(v), &v, sizeof(v));
+    }
+}
+
+static int getf_lua(lua_State *L, stats_method_e m, const char *op, int nbit)
+{
+    urandom_t *u      = checkurandom(L, 1);
+    int single        = lua_isnoneornil(L, 2);
+    size_t count      = single ? 1 : (size_t)lauxh_checkpint(L, 2);
+    size_t offset     = single ? 0 : check_dsttbl(L, 3);
+    size_t bytes_elem = nbit / 8;
+    int rc            = 0;
+
+    stats_add(u, calls[m], 1);
+    // check for overflow before multiplication
+    // also check if count is too large for lua_createtable's narr parameter
+    if (count > (SIZE_MAX / bytes_elem) || count > INT_MAX ||
+        offset > INT_MAX - count) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, op);
+        return 2;
+    }
+
+    rc = read_urandom(L, u, count * bytes_elem, op);
+    if (rc != 0) {
+        // read error
+        return rc;
+    }
+
+    if (nbit == 64) {
+        double *p = (double *)u->buf;
+        words2double(u->buf, count);
+        if (single) {
+            lua_pushnumber(L, *p);
+        } else {
+            push_dsttbl(L, 3, count);
+            for (size_t i = 1; i <= count; i++) {
+                lauxh_pushnum2arr(L, offset + i, *p);
+                p++;
+            }
+        }
+    } else {
+        float *p = (float *)u->buf;
+        words2float(u->buf, count);
+        if (single) {
+            lua_pushnumber(L, *p);
+        } else {
+            push_dsttbl(L, 3, count);
+            for (size_t i = 1; i <= count; i++) {
+                lauxh_pushnum2arr(L, offset + i, *p);
+                p++;
+            }
+        }
+    }
+    wipe_buf(u, count * bytes_elem);
+
+    return 1;
+}
+
+static int double_lua(lua_State *L)
+{
+    return getf_lua(L, STATS_DOUBLE, "os.urandom.double", 64);
+}
+
+static int float_lua(lua_State *L)
+{
+    return getf_lua(L, STATS_FLOAT, "os.urandom.float", 32);
+}
+
+static int bytes_lua(lua_State *L)
+{
+    urandom_t *u = checkurandom(L, 1);
+    size_t nbyte = (size_t)lauxh_checkpint(L, 2);
+    callopts_t opts;
+
+    stats_add(u, calls[STATS_BYTES], 1);
+    check_callopts(L, 3, &opts);
+    if (reserve_buf(L, u, nbyte) != 0 ||
+        fill_with(u, u->buf, nbyte, &opts) != 0) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "os.urandom.bytes");
+        return 2;
+    }
+    lua_pushlstring(L, u->buf, nbyte);
+    wipe_buf(u, nbyte);
+    return 1;
+}
+
+static const char *const ENCODINGS[] = {
+    [ENCODE_RAW]       = "raw",
+    [ENCODE_HEX]       = "hex",
+    [ENCODE_BASE64]    = "base64",
+    [ENCODE_BASE64URL] = "base64url",
+    NULL,
+};
+
+static int tokens_lua(lua_State *L)
+{
+    urandom_t *u       = checkurandom(L, 1);
+    size_t n           = (size_t)lauxh_checkpint(L, 2);
+    size_t size        = (size_t)lauxh_checkpint(L, 3);
+    encode_type_e type = luaL_checkoption(L, 4, "raw", ENCODINGS);
+    size_t elen        = 0;
+    const char *op     = "os.urandom.tokens";
+
+    stats_add(u, calls[STATS_TOKENS], 1);
+    if (lua_isnoneornil(L, 5)) {
+        lua_settop(L, 1);
+        lua_createtable(L, (n > INT_MAX) ? 0 : n, 0);
+    } else {
+        luaL_checktype(L, 5, LUA_TTABLE);
+        lua_settop(L, 5);
+        lua_replace(L, 2);
+        lua_settop(L, 2);
+    }
+
+    // check for overflow before multiplication
+    // also check if n is too large for lua_createtable's narr parameter
+    if (size > (SIZE_MAX / 3 - 1) || n > INT_MAX) {
+        goto ERANGE_ERROR;
+    }
+    elen = encode_len(type, size);
+    if (type == ENCODE_RAW) {
+        if (size > 0 && n > SIZE_MAX / size) {
+            goto ERANGE_ERROR;
+        }
+        // fill all tokens at once
+        if (reserve_buf(L, u, n * size) != 0 ||
+            fill_random(u, u->buf, n * size) != 0) {
+            goto READ_ERROR;
+        }
+    } else {
+        size_t raw = 0;
+
+        if (n > SIZE_MAX / (size + elen)) {
+            goto ERANGE_ERROR;
+        }
+        // fill all tokens at once after the area of the encoded tokens
+        raw = n * elen;
+        if (reserve_buf(L, u, raw + n * size) != 0 ||
+            fill_random(u, u->buf + raw, n * size) != 0) {
+            goto READ_ERROR;
+        }
+        for (size_t i = 0; i < n; i++) {
+            encode(type, u->buf + i * elen, (uint8_t *)u->buf + raw + i * size,
+                   size);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        lua_pushlstring(L, u->buf + i * elen, elen);
+        lua_rawseti(L, 2, i + 1);
+    }
+    wipe_buf(u, (type == ENCODE_RAW) ? n * size : n * (elen + size));
+    lua_settop(L, 2);
+    return 1;
+
+ERANGE_ERROR:
+    errno = ERANGE;
+
+READ_ERROR:
+    lua_pushnil(L);
+    lua_errno_new(L, errno, op);
+    return 2;
+}
+
+static int encoded_lua(lua_State *L, stats_method_e m, encode_type_e type,
+                       const char *op)
+{
+    urandom_t *u = checkurandom(L, 1);
+    size_t nbyte = (size_t)lauxh_checkpint(L, 2);
+    size_t len   = 0;
+
+    stats_add(u, calls[m], 1);
+    // check for overflow of the encoded length
+    if (nbyte > (SIZE_MAX / 3 - 1)) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, op);
+        return 2;
+    }
+
+    // random bytes are placed after the area of the encoded string, so the
+    // result is encoded directly into the internal buffer
+    len = encode_len(type, nbyte);
+    if (reserve_buf(L, u, len + nbyte) != 0 ||
+        fill_random(u, u->buf + len, nbyte) != 0) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, op);
+        return 2;
+    }
+    encode(type, u->buf, (uint8_t *)u->buf + len, nbyte);
+    lua_pushlstring(L, u->buf, len);
+    wipe_buf(u, len + nbyte);
+    return 1;
+}
+
+static int hex_lua(lua_State *L)
+{
+    return encoded_lua(L, STATS_HEX, ENCODE_HEX, "os.urandom.hex");
+}
+
+static int base64_lua(lua_State *L)
+{
+    return encoded_lua(L, STATS_BASE64, ENCODE_BASE64, "os.urandom.base64");
+}
+
+static int base64url_lua(lua_State *L)
+{
+    return encoded_lua(L, STATS_BASE64URL, ENCODE_BASE64URL,
+                       "os.urandom.base64url");
+}
+
+typedef enum {
+    ID_UUID4 = 0,
+    ID_UUID7,
+    ID_ULID,
+} id_type_e;
+
+/**
+ * generate the identifiers; a string if count is omitted, otherwise a table of
+ * count strings.
+ */
+static int id_lua(lua_State *L, stats_method_e m, id_type_e type,
+                  const char *op)
+{
+    urandom_t *u   = checkurandom(L, 1);
+    int single     = lua_isnoneornil(L, 2);
+    size_t count   = single ? 1 : (size_t)lauxh_checkpint(L, 2);
+    size_t len     = (type == ID_ULID) ? ULID_LEN : UUID_LEN;
+    size_t raw     = 0;
+    uint64_t ms    = 0;
+    int version    = (type == ID_UUID7) ? 7 : 4;
+    uint8_t *bytes = NULL;
+
+    stats_add(u, calls[m], 1);
+    // check for overflow before multiplication
+    // also check if count is too large for lua_createtable's narr parameter
+    if (count > SIZE_MAX / (len + UUID_SIZE) || count > INT_MAX) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, op);
+        return 2;
+    }
+
+    // random bytes of all identifiers are placed after the area of the
+    // formatted identifiers, and they are formatted into the internal buffer
+    raw = count * len;
+    if (reserve_buf(L, u, raw + count * UUID_SIZE) != 0 ||
+        fill_random(u, u->buf + raw, count * UUID_SIZE) != 0) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, op);
+        return 2;
+    }
+    bytes = (uint8_t *)u->buf + raw;
+    if (type != ID_UUID4) {
+        // all identifiers of a call share the timestamp
+        ms = uuid_unix_ms();
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *b = bytes + i * UUID_SIZE;
+
+        if (type != ID_UUID4) {
+            uuid_stamp_ms(b, ms);
+        }
+        if (type == ID_ULID) {
+            ulid_format(u->buf + i * len, b);
+        } else {
+            uuid_stamp_version(b, version);
+            uuid_format(u->buf + i * len, b);
+        }
+    }
+
+    lua_settop(L, 1);
+    if (single) {
+        lua_pushlstring(L, u->buf, len);
+    } else {
+        lua_createtable(L, (int)count, 0);
+        for (size_t i = 0; i < count; i++) {
+            lua_pushlstring(L, u->buf + i * len, len);
+            lua_rawseti(L, 2, (lua_Integer)i + 1);
+        }
+    }
+    wipe_buf(u, raw + count * UUID_SIZE);
+    return 1;
+}
+
+static int uuid4_lua(lua_State *L)
+{
+    return id_lua(L, STATS_UUID4, ID_UUID4, "os.urandom.uuid4");
+}
+
+static int uuid7_lua(lua_State *L)
+{
+    return id_lua(L, STATS_UUID7, ID_UUID7, "os.urandom.uuid7");
+}
+
+static int ulid_lua(lua_State *L)
+{
+    return id_lua(L, STATS_ULID, ID_ULID, "os.urandom.ulid");
+}
+
+static int range_lua(lua_State *L)
+{
+    urandom_t *u      = checkurandom(L, 1);
+    lua_Integer lo    = luaL_checkinteger(L, 2);
+    lua_Integer hi    = luaL_checkinteger(L, 3);
+    int single        = lua_isnoneornil(L, 4);
+    size_t count      = single ? 1 : (size_t)lauxh_checkpint(L, 4);
+    urandom_words_t w = {
+        .u  = u,
+        .op = "os.urandom.range",
+    };
+    // number of integers in [lo, hi]
+    uint64_t n   = (uint64_t)hi - (uint64_t)lo + 1;
+    size_t wsize = (n > 0 && n <= UINT32_MAX) ? 4 : 8;
+    uint64_t v   = 0;
+    int rc       = 0;
+
+    stats_add(u, calls[STATS_RANGE], 1);
+    luaL_argcheck(L, lo <= hi, 3, "hi must be greater than or equal to lo");
+    // check for overflow before multiplication
+    // also check if count is too large for lua_createtable's narr parameter
+    if (count > (SIZE_MAX / wsize) || count > INT_MAX) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, w.op);
+        return 2;
+    }
+
+    // read enough words for the case without rejection at once
+    if ((rc = words_fill(L, &w, count * wsize)) != 0) {
+        return rc;
+    }
+
+    lua_settop(L, 1);
+    if (single) {
+        if ((rc = words_bounded(L, &w, n, &v)) != 0) {
+            return rc;
+        }
+        lua_pushinteger(L, (lua_Integer)((uint64_t)lo + v));
+        words_wipe(&w);
+        return 1;
+    }
+
+    lua_createtable(L, count, 0);
+    for (size_t i = 1; i <= count; i++) {
+        if ((rc = words_bounded(L, &w, n, &v)) != 0) {
+            return rc;
+        }
+        lauxh_pushint2arr(L, i, (lua_Integer)((uint64_t)lo + v));
+    }
+    words_wipe(&w);
+    return 1;
+}
+
+#if LUA_VERSION_NUM >= 502
+# define urandom_rawlen(L, idx) lua_rawlen(L, idx)
+#else
+# define urandom_rawlen(L, idx) lua_objlen(L, idx)
+#endif
+
+/**
+ * shuffle the elements t[i..j] of the table at idx in place by Fisher-Yates.
+ * returns 0 on success, or the number of the values pushed on error.
+ */
+static int shuffle_table(lua_State *L, urandom_words_t *w, int idx,
+                         lua_Integer i, lua_Integer j)
+{
+    uint64_t r = 0;
+    int rc     = 0;
+
+    for (lua_Integer k = j; k > i; k--) {
+        if ((rc = words_bounded(L, w, (uint64_t)(k - i + 1), &r)) != 0) {
+            return rc;
+        } else if ((lua_Integer)r + i != k) {
+            // swap t[k] and t[i + r]
+            lua_rawgeti(L, idx, k);
+            lua_rawgeti(L, idx, (lua_Integer)r + i);
+            lua_rawseti(L, idx, k);
+            lua_rawseti(L, idx, (lua_Integer)r + i);
+        }
+    }
+    return 0;
+}
+
+static int shuffle_lua(lua_State *L)
+{
+    urandom_t *u      = checkurandom(L, 1);
+    lua_Integer i     = 0;
+    lua_Integer j     = 0;
+    urandom_words_t w = {
+        .u  = u,
+        .op = "os.urandom.shuffle",
+    };
+    int rc = 0;
+
+    stats_add(u, calls[STATS_SHUFFLE], 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    i = luaL_optinteger(L, 3, 1);
+    j = luaL_optinteger(L, 4, (lua_Integer)urandom_rawlen(L, 2));
+    luaL_argcheck(L, i >= 1, 3, "i must be greater than or equal to 1");
+    luaL_argcheck(L, j <= INT_MAX, 4, "j out of range");
+    lua_settop(L, 2);
+    if (j <= i) {
+        // nothing to shuffle
+        return 1;
+    } else if ((uint64_t)(j - i) > SIZE_MAX / sizeof(uint32_t)) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, w.op);
+        return 2;
+    }
+
+    // read enough words for the case without rejection at once
+    if ((rc = words_fill(L, &w, (size_t)(j - i) * sizeof(uint32_t))) != 0 ||
+        (rc = shuffle_table(L, &w, 2, i, j)) != 0) {
+        return rc;
+    }
+    words_wipe(&w);
+    return 1;
+}
+
+static int permutation_lua(lua_State *L)
+{
+    urandom_t *u      = checkurandom(L, 1);
+    lua_Integer n     = luaL_checkinteger(L, 2);
+    urandom_words_t w = {
+        .u  = u,
+        .op = "os.urandom.permutation",
+    };
+    uint64_t r = 0;
+    int rc     = 0;
+
+    stats_add(u, calls[STATS_PERMUTATION], 1);
+    luaL_argcheck(L, n >= 0, 2, "n must be greater than or equal to 0");
+    // also check if n is too large for lua_createtable's narr parameter
+    if (n > INT_MAX || (uint64_t)n > SIZE_MAX / sizeof(uint32_t)) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, w.op);
+        return 2;
+    }
+    // read enough words for the case without rejection at once
+    if (n > 1) {
+        rc = words_fill(L, &w, (size_t)(n - 1) * sizeof(uint32_t));
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    lua_settop(L, 1);
+    lua_createtable(L, (int)n, 0);
+    if (n > 0) {
+        lauxh_pushint2arr(L, 1, 1);
+    }
+    // inside-out Fisher-Yates; t[1..k] is a random permutation of 1..k
+    for (lua_Integer k = 2; k <= n; k++) {
+        if ((rc = words_bounded(L, &w, (uint64_t)k, &r)) != 0) {
+            return rc;
+        } else if ((lua_Integer)r + 1 == k) {
+            lauxh_pushint2arr(L, k, k);
+        } else {
+            // move t[r + 1] to t[k] and put k at t[r + 1]
+            lua_rawgeti(L, -1, (lua_Integer)r + 1);
+            lua_rawseti(L, -2, k);
+            lauxh_pushint2arr(L, (lua_Integer)r + 1, k);
+        }
+    }
+    if (n > 1) {
+        words_wipe(&w);
+    }
+    return 1;
+}
+
+static int choice_lua(lua_State *L)
+{
+    urandom_t *u      = checkurandom(L, 1);
+    size_t n          = 0;
+    int single        = lua_isnoneornil(L, 3);
+    size_t k          = 0;
+    urandom_words_t w = {
+        .u  = u,
+        .op = "os.urandom.choice",
+    };
+    uint64_t r = 0;
+    int rc     = 0;
+
+    stats_add(u, calls[STATS_CHOICE], 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    n = urandom_rawlen(L, 2);
+    luaL_argcheck(L, n > 0, 2, "t must not be empty");
+    luaL_argcheck(L, n <= INT_MAX, 2, "t is too large");
+    k = single ? 1 : (size_t)lauxh_checkpint(L, 3);
+    luaL_argcheck(L, k <= n, 3, "k must be less than or equal to #t");
+    // check for overflow before multiplication
+    if (k > SIZE_MAX / (sizeof(uint32_t) * 2)) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, w.op);
+        return 2;
+    }
+
+    // read enough words for the case without rejection at once; k words to
+    // choose and k - 1 words to shuffle the chosen elements
+    if ((rc = words_fill(L, &w, (k * 2 - 1) * sizeof(uint32_t))) != 0) {
+        return rc;
+    }
+
+    lua_settop(L, 2);
+    if (single) {
+        if ((rc = words_bounded(L, &w, n, &r)) != 0) {
+            return rc;
+        }
+        lua_rawgeti(L, 2, (lua_Integer)r + 1);
+        words_wipe(&w);
+        return 1;
+    }
+
+    // choose k distinct indexes by Floyd's algorithm
+    lua_createtable(L, 0, (int)k); // set of the chosen indexes
+    lua_createtable(L, (int)k, 0);
+    for (size_t j = n - k + 1, i = 1; j <= n; j++, i++) {
+        if ((rc = words_bounded(L, &w, j, &r)) != 0) {
+            return rc;
+        }
+        r++;
+        lua_rawgeti(L, 3, (lua_Integer)r);
+        if (!lua_isnil(L, -1)) {
+            // r is already chosen, but j is never chosen before
+            r = j;
+        }
+        lua_pop(L, 1);
+        lua_pushboolean(L, 1);
+        lua_rawseti(L, 3, (lua_Integer)r);
+        lua_rawgeti(L, 2, (lua_Integer)r);
+        lua_rawseti(L, 4, (lua_Integer)i);
+    }
+    // the subset is uniform, but its order is not
+    if ((rc = shuffle_table(L, &w, 4, 1, (lua_Integer)k)) != 0) {
+        return rc;
+    }
+    words_wipe(&w);
+    return 1;
+}
+
+/**
+ * alias table of Walker's alias method.
+ * the index i is chosen if a random 64-bit word is less than thr[i],
+ * otherwise alias[i] is chosen.
+ */
+typedef struct {
+    uint64_t thr;
+    uint32_t alias;
+} urandom_alias_entry_t;
+
+typedef struct {
+    size_t n;
+    urandom_alias_entry_t e[];
+} urandom_alias_t;
+
+/**
+ * build the alias table from the array of weights at idx by Vose's method,
+ * and push it onto the stack. throws an error if the weights are invalid.
+ */
+static urandom_alias_t *alias_build(lua_State *L, int idx)
+{
+    size_t n           = urandom_rawlen(L, idx);
+    double sum         = 0;
+    urandom_alias_t *a = NULL;
+    double *p          = NULL;
+    uint32_t *work     = NULL;
+    size_t nsmall      = 0;
+    size_t nlarge      = 0;
+
+    luaL_argcheck(L, n > 0, idx, "weights must not be empty");
+    luaL_argcheck(L,
+                  n <= INT_MAX &&
+                      n < SIZE_MAX / sizeof(urandom_alias_entry_t) - 1,
+                  idx, "weights is too large");
+    for (size_t i = 1; i <= n; i++) {
+        double v = 0;
+
+        lua_rawgeti(L, idx, (lua_Integer)i);
+        v = lua_tonumber(L, -1);
+        if (lua_type(L, -1) != LUA_TNUMBER || !(v >= 0) || isinf(v)) {
+            lua_pushfstring(
+                L, "weights[%d] must be a finite non-negative number", (int)i);
+            luaL_argerror(L, idx, lua_tostring(L, -1));
+        }
+        lua_pop(L, 1);
+        sum += v;
+    }
+    luaL_argcheck(L, sum > 0 && !isinf(sum), idx,
+                  "sum of weights must be a finite positive number");
+
+    a    = lua_newuserdata(L, sizeof(urandom_alias_t) +
+                                  sizeof(urandom_alias_entry_t) * n);
+    a->n = n;
+    // scaled probabilities and the worklists; the small indexes are pushed
+    // from the front and the large indexes from the back
+    p    = lua_newuserdata(L, (sizeof(double) + sizeof(uint32_t)) * n);
+    work = (uint32_t *)(p + n);
+    for (size_t i = 0; i < n; i++) {
+        lua_rawgeti(L, idx, (lua_Integer)i + 1);
+        p[i] = lua_tonumber(L, -1) / sum * (double)n;
+        lua_pop(L, 1);
+        if (p[i] < 1) {
+            work[nsmall++] = (uint32_t)i;
+        } else {
+            work[n - ++nlarge] = (uint32_t)i;
+        }
+    }
+    while (nsmall && nlarge) {
+        uint32_t s = work[--nsmall];
+        uint32_t l = work[n - nlarge];
+        double thr = ldexp(p[s], 64);
+
+        a->e[s].thr   = (thr < 0x1.0p64) ? (uint64_t)thr : UINT64_MAX;
+        a->e[s].alias = l;
+        p[l]          = (p[l] + p[s]) - 1;
+        if (p[l] < 1) {
+            // move l from the large list to the small list
+            nlarge--;
+            work[nsmall++] = l;
+        }
+    }
+    // the rest are 1 except for the rounding errors
+    while (nsmall) {
+        uint32_t i    = work[--nsmall];
+        a->e[i].thr   = UINT64_MAX;
+        a->e[i].alias = i;
+    }
+    while (nlarge) {
+        uint32_t i    = work[n - nlarge--];
+        a->e[i].thr   = UINT64_MAX;
+        a->e[i].alias = i;
+    }
+    lua_pop(L, 1);
+    lauxh_setmetatable(L, ALIAS_MT);
+    return a;
+}
+
+static int weighted_choice_lua(lua_State *L)
+{
+    urandom_t *u       = checkurandom(L, 1);
+    urandom_alias_t *a = NULL;
+    int single         = lua_isnoneornil(L, 3);
+    size_t k           = single ? 1 : (size_t)lauxh_checkpint(L, 3);
+    urandom_words_t w  = {
+        .u  = u,
+        .op = "os.urandom.weighted_choice",
+    };
+    // a 32-bit word to choose the column and a 64-bit word to choose the index
+    // or its alias
+    size_t wsize = sizeof(uint32_t) + sizeof(uint64_t);
+    int rc       = 0;
+
+    stats_add(u, calls[STATS_WEIGHTED_CHOICE], 1);
+    lua_settop(L, 2);
+    if (lua_type(L, 2) == LUA_TUSERDATA) {
+        a = luaL_checkudata(L, 2, ALIAS_MT);
+    } else {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        a = alias_build(L, 2);
+    }
+    // check for overflow before multiplication
+    // also check if k is too large for lua_createtable's narr parameter
+    if (k > (SIZE_MAX / wsize) || k > INT_MAX) {
+        lua_pushnil(L);
+        lua_errno_new(L, ERANGE, w.op);
+        return 2;
+    }
+
+    // read enough words for the case without rejection at once
+    if ((rc = words_fill(L, &w, k * wsize)) != 0) {
+        return rc;
+    }
+
+    if (!single) {
+        lua_createtable(L, (int)k, 0);
+    }
+    for (size_t i = 1; i <= k; i++) {
+        uint64_t col = 0;
+        uint64_t x   = 0;
+
+        if ((rc = words_bounded(L, &w, a->n, &col)) != 0 ||
+            (rc = words_next(L, &w, &x, sizeof(x))) != 0) {
+            return rc;
+        }
+        if (x >= a->e[col].thr) {
+            col = a->e[col].alias;
+        }
+        if (single) {
+            lua_pushinteger(L, (lua_Integer)col + 1);
+        } else {
+            lauxh_pushint2arr(L, i, (lua_Integer)col + 1);
+        }
+    }
+    words_wipe(&w);
+    return 1;
+}
+
+/**
+ * get a random 64-bit word without using the internal buffer.
+ * returns 0 on success, or the number of the values pushed on error.
+ */
+static int next_word(lua_State *L, urandom_t *u, const char *op, uint64_t *x)
 {
-    char *buf = (nbyte > u->len) ? lua_newuserdata(L, nbyte) : u->buf;
-
-    if (secrandom(buf, nbyte, &u->fd_cached) != SECRANDOM_SUCCESS) {
-        // secrandom failed
+    if (fill_random(u, x, sizeof(*x)) != 0) {
         lua_pushnil(L);
         lua_errno_new(L, errno, op);
         return 2;
     }
+    return 0;
+}
 
-    if (buf != u->buf) {
-        // if the buffer is different, free the old one and set the new one
-        u->buf     = buf;
-        u->len     = nbyte;
-        u->ref_buf = lauxh_unref(L, u->ref_buf);
-        u->ref_buf = lauxh_ref(L);
+/**
+ * get a random floating-point number in (0, 1) without using the internal
+ * buffer. returns 0 on success, or the number of the values pushed on error.
+ */
+static int next_open01(lua_State *L, urandom_t *u, const char *op, double *v)
+{
+    uint64_t x = 0;
+    int rc     = next_word(L, u, op, &x);
+
+    if (rc == 0) {
+        // use the upper 53 bits as the mantissa and exclude 0
+        *v = ((double)(x >> 11) + 0.5) * 0x1.0p-53;
     }
+    return rc;
+}
 
-    return 0;
+/**
+ * call the iterator at idx and leave the result on the stack.
+ * returns 0 if the result is nil.
+ */
+static inline int call_iter(lua_State *L, int idx)
+{
+    lua_pushvalue(L, idx);
+    lua_call(L, 0, 1);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return 0;
+    }
+    return 1;
 }
 
-static inline int getu_lua(lua_State *L, const char *op, int nbit)
+static int reservoir_lua(lua_State *L)
 {
-    urandom_t *u      = luaL_checkudata(L, 1, MODULE_MT);
-    size_t count      = (size_t)lauxh_checkpint(L, 2);
-    size_t bytes_elem = nbit / 8;
-    int rc            = 0;
+    urandom_t *u   = checkurandom(L, 1);
+    size_t k       = 0;
+    const char *op = "os.urandom.reservoir";
+    double r       = 0;
+    double wk      = 0;
+    uint64_t t     = 0;
+    int rc         = 0;
 
-    // check for overflow before multiplication
-    // also check if count is too large for lua_createtable's narr parameter
-    if (count > (SIZE_MAX / bytes_elem) || count > INT_MAX) {
-        lua_pushnil(L);
-        lua_errno_new(L, ERANGE, op);
-        return 2;
+    stats_add(u, calls[STATS_RESERVOIR], 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    k = (size_t)lauxh_checkpint(L, 3);
+    luaL_argcheck(L, k <= INT_MAX, 3, "k is too large");
+    lua_settop(L, 2);
+    lua_createtable(L, (int)k, 0);
+
+    // fill the reservoir with the first k elements
+    for (size_t i = 1; i <= k; i++) {
+        if (!call_iter(L, 2)) {
+            return 1;
+        }
+        lua_rawseti(L, 3, (lua_Integer)i);
     }
 
-    rc = read_urandom(L, u, count * bytes_elem, op);
-    if (rc != 0) {
-        // read error
+    // Li's algorithm L; skip the elements that are not sampled without
+    // drawing random numbers for them.
+    // the random numbers are not read through the internal buffer, since the
+    // iterator may use this instance.
+    if ((rc = next_open01(L, u, op, &r)) != 0) {
         return rc;
     }
+    wk = exp(log(r) / (double)k);
+    // threshold of the rejection to choose the element to be replaced
+    t  = -(uint64_t)k % k;
+    while (1) {
+        double skip = 0;
+        uint64_t x  = 0;
+        uint64_t lo = 0;
+        uint64_t hi = 0;
+
+        if ((rc = next_open01(L, u, op, &r)) != 0) {
+            return rc;
+        }
+        // skip may be inf; it is consumed until the iterator ends
+        for (skip = floor(log(r) / log1p(-wk)); skip > 0; skip--) {
+            if (!call_iter(L, 2)) {
+                return 1;
+            }
+            lua_pop(L, 1);
+        }
+        if (!call_iter(L, 2)) {
+            return 1;
+        }
+
+        // replace a random element of the reservoir
+        do {
+            if ((rc = next_word(L, u, op, &x)) != 0) {
+                return rc;
+            }
+            hi = mul64(x, k, &lo);
+        } while (lo < t);
+        lua_rawseti(L, 3, (lua_Integer)hi + 1);
+
+        if ((rc = next_open01(L, u, op, &r)) != 0) {
+            return rc;
+        }
+        wk *= exp(log(r) / (double)k);
+    }
+}
+
+static int alias_len_lua(lua_State *L)
+{
+    urandom_alias_t *a = luaL_checkudata(L, 1, ALIAS_MT);
+    lua_pushinteger(L, (lua_Integer)a->n);
+    return 1;
+}
+
+static int alias_tostring_lua(lua_State *L)
+{
+    luaL_checkudata(L, 1, ALIAS_MT);
+    lua_pushfstring(L, ALIAS_MT ": %p", lua_topointer(L, 1));
+    return 1;
+}
+
+static int buffer_len_lua(lua_State *L)
+{
+    luaL_checkudata(L, 1, BUFFER_MT);
+    lua_pushinteger(L, (lua_Integer)urandom_rawlen(L, 1));
+    return 1;
+}
+
+static int buffer_tostring_lua(lua_State *L)
+{
+    luaL_checkudata(L, 1, BUFFER_MT);
+    lua_pushfstring(L, BUFFER_MT ": %p", lua_topointer(L, 1));
+    return 1;
+}
+
+static int buffer_read_lua(lua_State *L)
+{
+    char *buf          = luaL_checkudata(L, 1, BUFFER_MT);
+    size_t size        = urandom_rawlen(L, 1);
+    lua_Integer offset = luaL_optinteger(L, 2, 0);
+    lua_Integer len    = 0;
+
+    luaL_argcheck(L, offset >= 0 && (size_t)offset <= size, 2,
+                  "offset out of range");
+    len = luaL_optinteger(L, 3, (lua_Integer)(size - (size_t)offset));
+    luaL_argcheck(L, len >= 0 && (size_t)len <= size - (size_t)offset, 3,
+                  "length out of range");
+    lua_pushlstring(L, buf + offset, (size_t)len);
+    return 1;
+}
 
+static int buffer_lua(lua_State *L)
+{
+    size_t size = (size_t)lauxh_checkpint(L, 1);
+    char *buf   = lua_newuserdata(L, size);
+
+    // zero-filled byte buffer for urandom:fill()
+    memset(buf, 0, size);
+    lauxh_setmetatable(L, BUFFER_MT);
+    return 1;
+}
+
+static int alias_lua(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
     lua_settop(L, 1);
-    lua_createtable(L, count, 0);
+    alias_build(L, 1);
+    return 1;
+}
 
-#define push_ival(t, v)                                                        \
-    do {                                                                       \
-        t *p = (v);                                                            \
-        for (size_t i = 1; i <= count; i++) {                                  \
-            lauxh_pushint2arr(L, i, *p);                                       \
-            p++;                                                               \
-        }                                                                      \
-    } while (0)
+/**
+ * check if the value at idx is a userdata that can be used as a byte buffer;
+ * a userdata without metatable, or an os.urandom.buffer. the userdata of the
+ * other types (e.g. file handles or os.urandom itself) are rejected, since
+ * overwriting them breaks their state.
+ */
+static char *checkbuffer(lua_State *L, int idx, size_t *size)
+{
+    luaL_checktype(L, idx, LUA_TUSERDATA);
+    if (lua_getmetatable(L, idx)) {
+        int ok = 0;
 
-    if (nbit == 8) {
-        push_ival(uint8_t, u->i8);
-    } else if (nbit == 16) {
-        push_ival(uint16_t, u->i16);
-    } else if (nbit == 32) {
-        push_ival(uint32_t, u->i32);
+        luaL_getmetatable(L, BUFFER_MT);
+        ok = lua_rawequal(L, -1, -2);
+        lua_pop(L, 2);
+        if (!ok) {
+            luaL_argerror(L, idx,
+                          "userdata without metatable or " BUFFER_MT
+                          " expected");
+        }
     }
+    *size = urandom_rawlen(L, idx);
+    return lua_touserdata(L, idx);
+}
 
-#undef push_ival
+static int fill_lua(lua_State *L)
+{
+    urandom_t *u       = checkurandom(L, 1);
+    size_t size        = 0;
+    lua_Integer offset = 0;
+    lua_Integer len    = 0;
+    char *dst          = NULL;
+    callopts_t opts;
+
+    stats_add(u, calls[STATS_FILL], 1);
+    dst    = checkbuffer(L, 2, &size);
+    offset = luaL_optinteger(L, 3, 0);
+    luaL_argcheck(L, offset >= 0 && (size_t)offset <= size, 3,
+                  "offset out of range");
+    len = luaL_optinteger(L, 4, (lua_Integer)(size - (size_t)offset));
+    luaL_argcheck(L, len >= 0 && (size_t)len <= size - (size_t)offset, 4,
+                  "length out of range");
+    check_callopts(L, 5, &opts);
 
+    // write random bytes directly into the userdata without extra copy
+    if (fill_with(u, dst + offset, (size_t)len, &opts) != 0) {
+        lua_pushnil(L);
+        lua_errno_new(L, errno, "os.urandom.fill");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
     return 1;
 }
 
-static int get32u_lua(lua_State *L)
+// default number of bytes written by each write(2) in urandom:write_to()
+#define WRITE_CHUNK_SIZE (64 * 1024)
+
+/**
+ * get the file descriptor from the integer or the Lua file handle at idx.
+ */
+static int checkfd(lua_State *L, int idx)
 {
-    return getu_lua(L, "os.urandom.get32u", 32);
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+        lua_Integer fd = luaL_checkinteger(L, idx);
+        luaL_argcheck(L, fd >= 0 && fd <= INT_MAX, idx,
+                      "invalid file descriptor");
+        return (int)fd;
+    } else {
+#if LUA_VERSION_NUM >= 502
+        luaL_Stream *stream = luaL_checkudata(L, idx, LUA_FILEHANDLE);
+        FILE *fp            = stream->closef ? stream->f : NULL;
+#else
+        FILE *fp = *(FILE **)luaL_checkudata(L, idx, LUA_FILEHANDLE);
+#endif
+        luaL_argcheck(L, fp != NULL, idx, "attempt to use a closed file");
+        // write the pending data of the stream before writing to fd
+        fflush(fp);
+        return fileno(fp);
+    }
 }
 
-static int get16u_lua(lua_State *L)
+static int write_to_lua(lua_State *L)
 {
-    return getu_lua(L, "os.urandom.get16u", 16);
+    urandom_t *u      = checkurandom(L, 1);
+    int fd            = checkfd(L, 2);
+    lua_Integer nbyte = luaL_checkinteger(L, 3);
+    size_t chunk      = (size_t)lauxh_optpint(L, 4, WRITE_CHUNK_SIZE);
+    size_t remain     = 0;
+    size_t total      = 0;
+
+    stats_add(u, calls[STATS_WRITE_TO], 1);
+    luaL_argcheck(L, nbyte >= 0, 3, "non-negative integer expected");
+    remain = (size_t)nbyte;
+    if (chunk > remain) {
+        chunk = remain;
+    }
+    // reuse the buffer of the instance so memory use stays constant
+    if (reserve_buf(L, u, chunk) != 0) {
+        goto FAIL;
+    }
+
+    while (remain > 0) {
+        size_t n  = (remain < chunk) ? remain : chunk;
+        char *ptr = u->buf;
+
+        if (fill_random(u, ptr, n) != 0) {
+            goto FAIL;
+        }
+        while (n > 0) {
+            ssize_t rv = write(fd, ptr, n);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                goto FAIL;
+            }
+            ptr += rv;
+            n -= (size_t)rv;
+            total += (size_t)rv;
+            remain -= (size_t)rv;
+        }
+    }
+    wipe_buf(u, chunk);
+    lua_pushinteger(L, (lua_Integer)total);
+    return 1;
+
+FAIL:
+    wipe_buf(u, chunk);
+    lua_pushnil(L);
+    lua_errno_new(L, errno, "os.urandom.write_to");
+    lua_pushinteger(L, (lua_Integer)total);
+    return 3;
 }
 
-static int get8u_lua(lua_State *L)
+static int shrink_lua(lua_State *L)
 {
-    return getu_lua(L, "os.urandom.get8u", 8);
+    urandom_t *u = checkurandom(L, 1);
+
+    release_buf(L, u);
+    return 0;
 }
 
-static int bytes_lua(lua_State *L)
+#define stats_pushint2tbl(L, k, v)                                             \
+    lauxh_pushint2tbl(L, k, (lua_Integer)stats_atomic_load(&(v)))
+
+/**
+ * push the table of the counters.
+ */
+static void push_stats(lua_State *L, stats_t *stats)
 {
-    urandom_t *u = luaL_checkudata(L, 1, MODULE_MT);
-    size_t nbyte = (size_t)lauxh_checkpint(L, 2);
-    int rc       = read_urandom(L, u, nbyte, "os.urandom.bytes");
+    const secrandom_backend_t *backends = secrandom_backends();
 
-    if (rc != 0) {
-        // read error
-        return rc;
+    lua_createtable(L, 0, 10);
+    lua_createtable(L, 0, STATS_NMETHOD);
+    for (int i = 0; i < STATS_NMETHOD; i++) {
+        stats_pushint2tbl(L, STATS_METHOD_NAMES[i], stats->calls[i]);
+    }
+    lua_setfield(L, -2, "calls");
+    stats_pushint2tbl(L, "bytes", stats->bytes);
+    stats_pushint2tbl(L, "os_calls", stats->os_calls);
+    stats_pushint2tbl(L, "os_errors", stats->os_errors);
+    lauxh_pushnum2tbl(L, "os_time",
+                      (lua_Number)stats_atomic_load(&stats->os_ns) / 1e9);
+    stats_pushint2tbl(L, "refills", stats->refills);
+    stats_pushint2tbl(L, "reseeds", stats->reseeds);
+    stats_pushint2tbl(L, "grows", stats->grows);
+    lua_newtable(L);
+    for (int i = 0; i < STATS_MAX_BACKENDS && backends[i].name; i++) {
+        stats_pushint2tbl(L, backends[i].name, stats->fallbacks[i]);
+    }
+    lua_setfield(L, -2, "fallbacks");
+}
+
+#undef stats_pushint2tbl
+
+#if !defined(_WIN32)
+/**
+ * add the counters of the producer thread to the counters.
+ */
+static void add_prefetch_stats(stats_t *stats, prefetch_t *p)
+{
+    uint64_t *dst       = (uint64_t *)stats;
+    const uint64_t *src = (const uint64_t *)&p->stats;
+
+    for (size_t i = 0; i < sizeof(stats_t) / sizeof(uint64_t); i++) {
+        dst[i] += stats_atomic_load(&src[i]);
+    }
+}
+#endif
+
+static int stats_lua(lua_State *L)
+{
+    urandom_t *u  = checkurandom(L, 1);
+    stats_t stats = u->stats;
+
+#if !defined(_WIN32)
+    // add the reads and the reseeds of the producer thread
+    check_fork(u);
+    if (u->prefetch) {
+        add_prefetch_stats(&stats, u->prefetch);
+    }
+#endif
+    push_stats(L, &stats);
+    return 1;
+}
+
+static int backend_lua(lua_State *L)
+{
+    urandom_t *u = checkurandom(L, 1);
+
+    if (u->seeded) {
+        lua_pushliteral(L, "seed");
+    } else if (u->backend) {
+        lua_pushstring(L, u->backend->name);
+        if (u->backend_large && u->backend_large != u->backend) {
+            lua_pushstring(L, u->backend_large->name);
+            return 2;
+        }
+    } else {
+        lua_pushnil(L);
     }
-    lua_pushlstring(L, u->buf, nbyte);
     return 1;
 }
 
 static int close_lua(lua_State *L)
 {
-    urandom_t *u = luaL_checkudata(L, 1, MODULE_MT);
+    urandom_t *u = checkurandom(L, 1);
 
     if (u->fd_cached != -1) {
         close(u->fd_cached);
         u->fd_cached = -1;
     }
+    if (u->secure) {
+        release_buf(L, u);
+        if (u->state) {
+            // the pool is reseeded and the read-ahead buffer is refilled on
+            // the next read
+            wipe(u->state, u->state_size);
+            u->state->alive = 1;
+            u->rpos         = u->rsize;
+        }
+#if !defined(_WIN32)
+        // the ring holds the blocks generated before closing, and the pool
+        // of the producer keeps its key; stop it and wipe them
+        check_fork(u);
+        if (u->prefetch) {
+            add_prefetch_stats(&u->stats, u->prefetch);
+            prefetch_free(u->prefetch);
+            u->prefetch = NULL;
+        }
+#endif
+    }
 
     return 0;
 }
 
 static int tostring_lua(lua_State *L)
 {
-    luaL_checkudata(L, 1, MODULE_MT);
-    lua_pushfstring(L, MODULE_MT ": %p", lua_topointer(L, 1));
+    urandom_t *u = checkurandom(L, 1);
+    lua_pushfstring(L, "%s: %p", u->seeded ? SEEDED_MT : MODULE_MT,
+                    lua_topointer(L, 1));
     return 1;
 }
 
@@ -172,26 +2239,347 @@ static int gc_lua(lua_State *L)
     if (u->fd_cached != -1) {
         close(u->fd_cached);
     }
-    lauxh_unref(L, u->ref_buf);
+    release_buf(L, u);
+    // discard the producer without joining it if the process has been forked
+    check_fork(u);
+#if !defined(_WIN32)
+    if (u->prefetch) {
+        prefetch_free(u->prefetch);
+    }
+#endif
+    if (u->state) {
+        wipe(u->state, u->state_size);
+        secmem_free(u->state, u->state_size);
+    }
 
     return 0;
 }
 
+// default minimum size of the buffer allocated outside of the GC heap
+#define MMAP_THRESHOLD (1024 * 1024)
+
+/**
+ * measure the backends for backend = "fastest".
+ */
+static void calibrate(void)
+{
+    FASTEST_SMALL = secrandom_fastest(16, 256);
+    FASTEST_LARGE = secrandom_fastest(256 * 1024, 4);
+    CALIBRATED    = 1;
+}
+
+/**
+ * select the backends by the name of the backend option. returns 0 on success,
+ * or -1 with errno set if the backend does not work on this system.
+ */
+static int select_backend(lua_State *L, const char *name,
+                          const secrandom_backend_t **backend,
+                          const secrandom_backend_t **backend_large,
+                          int *strict)
+{
+    unsigned char probe[16];
+    const secrandom_backend_t *b = NULL;
+
+    if (strcmp(name, "auto") == 0) {
+        *backend = BACKEND;
+        return 0;
+    } else if (strcmp(name, "fastest") == 0) {
+        // measure the backends only once per process
+#if defined(_WIN32)
+        if (!CALIBRATED) {
+            calibrate();
+        }
+#else
+        pthread_once(&CALIBRATE_ONCE, calibrate);
+#endif
+        *backend       = FASTEST_SMALL ? FASTEST_SMALL : BACKEND;
+        *backend_large = FASTEST_LARGE;
+        return 0;
+    } else if ((b = secrandom_lookup(name)) == NULL) {
+        lua_pushfstring(L, "backend: unknown backend \"%s\"", name);
+        return luaL_argerror(L, 1, lua_tostring(L, -1));
+    }
+
+    switch (b->func(probe, sizeof(probe), NULL)) {
+    case SECRANDOM_SUCCESS:
+        *backend = b;
+        *strict  = 1;
+        return 0;
+    case SECRANDOM_UNSUPPORTED:
+        errno = ENOSYS;
+        return -1;
+    default:
+        errno = EIO;
+        return -1;
+    }
+}
+
 static int new_lua(lua_State *L)
 {
-    urandom_t *u = lua_newuserdata(L, sizeof(urandom_t));
+    int pooled                               = 0;
+    size_t rsize                             = 0;
+    size_t mmap_threshold                    = MMAP_THRESHOLD;
+    int mmap_flags                           = 0;
+    int secure                               = 0;
+    int hwrng                                = 0;
+    int strict                               = 0;
+    int nonblock                             = 0;
+    size_t prefetch                          = 0;
+    const char *seed                         = NULL;
+    size_t seedlen                           = 0;
+    const secrandom_backend_t *backend       = BACKEND;
+    const secrandom_backend_t *backend_large = NULL;
+    urandom_t *u                             = NULL;
+
+    if (!lua_isnoneornil(L, 1)) {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        if (checkopt(L, 1, "seed", LUA_TSTRING)) {
+            // the string is kept alive by the options table
+            seed = lua_tolstring(L, -1, &seedlen);
+            lua_pop(L, 1);
+            // the seeded stream is generated only by the pool
+            pooled = 1;
+        }
+        if (checkopt(L, 1, "pool", LUA_TSTRING)) {
+            const char *pool = lua_tostring(L, -1);
+            if (strcmp(pool, "chacha20") != 0) {
+                lua_pushfstring(L, "pool: unknown pool \"%s\"", pool);
+                return luaL_argerror(L, 1, lua_tostring(L, -1));
+            }
+            pooled = 1;
+            lua_pop(L, 1);
+        }
+        rsize          = optsize(L, 1, "buffer", 0);
+        prefetch       = optsize(L, 1, "prefetch", 0);
+        luaL_argcheck(L, prefetch == 0 || rsize > 0, 1,
+                      "prefetch: requires the buffer option");
+        mmap_threshold = optsize(L, 1, "mmap", MMAP_THRESHOLD);
+        if (checkopt(L, 1, "hugepage", LUA_TBOOLEAN)) {
+            if (lua_toboolean(L, -1)) {
+                mmap_flags |= SECMEM_HUGEPAGE;
+            }
+            lua_pop(L, 1);
+        }
+        if (checkopt(L, 1, "secure", LUA_TBOOLEAN)) {
+            secure = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+        }
+        if (checkopt(L, 1, "hwrng", LUA_TBOOLEAN)) {
+            hwrng = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+            luaL_argcheck(L, !hwrng || pooled, 1,
+                          "hwrng: requires the pool option");
+        }
+        if (checkopt(L, 1, "nonblock", LUA_TBOOLEAN)) {
+            nonblock = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+        }
+        if (checkopt(L, 1, "backend", LUA_TSTRING)) {
+            luaL_argcheck(L, !seed, 1,
+                          "backend: cannot be used with the seed option");
+            if (select_backend(L, lua_tostring(L, -1), &backend,
+                               &backend_large, &strict) != 0) {
+                lua_pushnil(L);
+                lua_errno_new(L, errno, "os.urandom");
+                return 2;
+            }
+            lua_pop(L, 1);
+        }
+        // these options depend on the randomness of the operating system, or
+        // wipe the state that the seeded stream depends on
+        luaL_argcheck(L, !seed || !prefetch, 1,
+                      "prefetch: cannot be used with the seed option");
+        luaL_argcheck(L, !seed || !secure, 1,
+                      "secure: cannot be used with the seed option");
+        luaL_argcheck(L, !seed || !hwrng, 1,
+                      "hwrng: cannot be used with the seed option");
+    }
+    if (secure) {
+        // every buffer is allocated in the locked pages
+        mmap_threshold = 1;
+        mmap_flags |= SECMEM_LOCK;
+    }
 
+    u  = lua_newuserdata(L, sizeof(urandom_t));
     *u = (urandom_t){
-        .fd_cached = -1,
-        .buf       = NULL,
-        .len       = 0,
-        .ref_buf   = LUA_NOREF,
+        .fd_cached      = -1,
+        .buf            = NULL,
+        .len            = 0,
+        .ref_buf        = LUA_NOREF,
+        .mmap_threshold = mmap_threshold,
+        .mmap_flags     = mmap_flags,
+        .secure         = secure,
+        .backend        = backend,
+        .backend_large  = backend_large,
+        .strict         = strict,
+        .nonblock       = nonblock,
+        .pooled         = pooled,
+        .hwrng          = hwrng && HWRNG_AVAILABLE,
+        .seeded         = seed != NULL,
     };
-    lauxh_setmetatable(L, MODULE_MT);
+    lauxh_setmetatable(L, seed ? SEEDED_MT : MODULE_MT);
+
+    if (pooled || rsize > 0) {
+        // allocate the state in the pages that are wiped on fork(), except for
+        // the seeded stream that the child process continues
+        size_t size = 0;
+
+        if (rsize > SIZE_MAX - sizeof(urandom_state_t) ||
+            (size = secmem_size(sizeof(urandom_state_t) + rsize)) == 0) {
+            lua_pushnil(L);
+            lua_errno_new(L, ENOMEM, "os.urandom");
+            return 2;
+        }
+        u->state = secmem_alloc(size, (seed ? 0 : SECMEM_WIPEONFORK) |
+                                          (secure ? SECMEM_LOCK : 0));
+        if (u->state == NULL) {
+            lua_pushnil(L);
+            lua_errno_new(L, errno, "os.urandom");
+            return 2;
+        }
+        u->state_size   = size;
+        u->state->alive = 1;
+        u->forkgen      = FORK_GENERATION;
+        // the read-ahead buffer is empty until the first read
+        u->rbuf  = u->state->rbuf;
+        u->rsize = rsize;
+        u->rpos  = rsize;
+        if (seed) {
+            uint8_t key[CHACHA20_KEY_SIZE];
+
+            chacha20_derive_key(key, seed, seedlen);
+            chacha20_pool_reseed(&u->state->pool, key);
+            chacha20_wipe(key, sizeof(key));
+        }
+    }
+
+#if !defined(_WIN32)
+    if (prefetch) {
+        // the blocks are read with backend_large only if they are large
+        // enough, as in read_os()
+        u->prefetch = prefetch_new(
+            u->backend, rsize >= READ_LARGE_SIZE ? u->backend_large : NULL,
+            u->strict, pooled, u->hwrng, rsize, prefetch,
+            secure ? SECMEM_LOCK : 0, STATS);
+        if (u->prefetch == NULL) {
+            lua_pushnil(L);
+            lua_errno_new(L, errno, "os.urandom");
+            return 2;
+        }
+        u->prefetch_size = u->prefetch->size;
+    }
+#endif
+
+    return 1;
+}
+
+static int shared_lua(lua_State *L)
+{
+    lua_settop(L, 0);
+    lua_getfield(L, LUA_REGISTRYINDEX, SHARED_KEY);
+    if (lua_isnil(L, 1)) {
+        // create the pooled instance shared in this lua_State
+        lua_settop(L, 0);
+        lua_createtable(L, 0, 1);
+        lua_pushliteral(L, "chacha20");
+        lua_setfield(L, 1, "pool");
+        if (new_lua(L) != 1) {
+            // failed to create the instance
+            return 2;
+        }
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, SHARED_KEY);
+    }
+    return 1;
+}
+
+static int is_instance_lua(lua_State *L)
+{
+    lua_pushboolean(L, tourandom(L, 1) != NULL);
+    return 1;
+}
+
+static int ready_lua(lua_State *L)
+{
+    lua_pushboolean(L, check_ready() == 0);
+    return 1;
+}
+
+static int readyfd_lua(lua_State *L)
+{
+#if defined(_WIN32)
+    lua_pushnil(L);
+    lua_errno_new(L, ENOSYS, "os.urandom.readyfd");
+    return 2;
+#else
+    int fd = ready_load(&READY_FD);
+
+    if (fd == -1) {
+        int expected = -1;
+
+        // /dev/random gets readable once the kernel RNG is initialized
+        fd = open("/dev/random", O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            lua_pushnil(L);
+            lua_errno_new(L, errno, "os.urandom.readyfd");
+            return 2;
+        } else if (!ready_cas(&READY_FD, &expected, fd)) {
+            // another thread has opened it first
+            close(fd);
+            fd = expected;
+        }
+    }
+    lua_pushinteger(L, fd);
+    return 1;
+#endif
+}
+
+static int module_stats_lua(lua_State *L)
+{
+    stats_t stats;
 
+    stats_sum(&stats, STATS);
+    push_stats(L, &stats);
     return 1;
 }
 
+/**
+ * initialize the process-wide state. it is called only once per process.
+ */
+static void init_process(void)
+{
+    uint8_t probe[8];
+
+    // resolve the backend once instead of on every call
+    BACKEND         = secrandom_resolve();
+    HWRNG_AVAILABLE = secrandom_hwrng(probe, sizeof(probe)) ==
+                      SECRANDOM_SUCCESS;
+#if !defined(_WIN32)
+    // detect fork() to discard the pool and the read-ahead buffer
+    (void)pthread_atfork(NULL, NULL, atfork_child);
+#endif
+}
+
+/**
+ * fill the buffer with random bytes by the instance without the Lua C API, so
+ * that os.urandom.ffi can call it through the LuaJIT FFI without aborting the
+ * JIT trace. u must be the payload of an os.urandom or os.urandom.seeded
+ * userdata, which the caller must keep alive during the call.
+ * returns 0 on success, or -1 with errno set on failure.
+ */
+LUALIB_API int os_urandom_fill(urandom_t *u, void *buf, size_t len)
+{
+    stats_add(u, calls[STATS_FFI_FILL], 1);
+    return fill_random(u, buf, len);
+}
+
+static int call_lua(lua_State *L)
+{
+    // remove the module table
+    lua_remove(L, 1);
+    return new_lua(L);
+}
+
 LUALIB_API int luaopen_os_urandom(lua_State *L)
 {
     // create metatable
@@ -202,12 +2590,45 @@ LUALIB_API int luaopen_os_urandom(lua_State *L)
             {NULL,         NULL        }
         };
         struct luaL_Reg method[] = {
-            {"close",  close_lua },
-            {"bytes",  bytes_lua },
-            {"get8u",  get8u_lua },
-            {"get16u", get16u_lua},
-            {"get32u", get32u_lua},
-            {NULL,     NULL      }
+            {"close",           close_lua          },
+            {"backend",         backend_lua        },
+            {"bytes",           bytes_lua          },
+            {"fill",            fill_lua           },
+            {"write_to",        write_to_lua       },
+            {"shrink",          shrink_lua         },
+            {"stats",           stats_lua          },
+            {"tokens",          tokens_lua         },
+            {"hex",             hex_lua            },
+            {"base64",          base64_lua         },
+            {"base64url",       base64url_lua      },
+            {"uuid4",           uuid4_lua          },
+            {"uuid7",           uuid7_lua          },
+            {"ulid",            ulid_lua           },
+            {"range",           range_lua          },
+            {"shuffle",         shuffle_lua        },
+            {"permutation",     permutation_lua    },
+            {"choice",          choice_lua         },
+            {"weighted_choice", weighted_choice_lua},
+            {"reservoir",       reservoir_lua      },
+            {"get8u",           get8u_lua          },
+            {"get16u",          get16u_lua         },
+            {"get32u",          get32u_lua         },
+            {"get64u",          get64u_lua         },
+            {"get8i",           get8i_lua          },
+            {"get16i",          get16i_lua         },
+            {"get32i",          get32i_lua         },
+            {"get64i",          get64i_lua         },
+            {"u8",              u8_lua             },
+            {"u16",             u16_lua            },
+            {"u32",             u32_lua            },
+            {"u64",             u64_lua            },
+            {"i8",              i8_lua             },
+            {"i16",             i16_lua            },
+            {"i32",             i32_lua            },
+            {"i64",             i64_lua            },
+            {"double",          double_lua         },
+            {"float",           float_lua          },
+            {NULL,              NULL               }
         };
 
         // metamethods
@@ -222,8 +2643,75 @@ LUALIB_API int luaopen_os_urandom(lua_State *L)
         lua_setfield(L, -2, "__index");
         lua_pop(L, 1);
     }
+    // metatable of the seeded instance shares the methods
+    if (luaL_newmetatable(L, SEEDED_MT)) {
+        lauxh_pushfn2tbl(L, "__gc", gc_lua);
+        lauxh_pushfn2tbl(L, "__tostring", tostring_lua);
+        luaL_getmetatable(L, MODULE_MT);
+        lua_getfield(L, -1, "__index");
+        lua_setfield(L, -3, "__index");
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    // metatable of the byte buffer returned by urandom.buffer()
+    if (luaL_newmetatable(L, BUFFER_MT)) {
+        struct luaL_Reg mmethod[] = {
+            {"__len",      buffer_len_lua     },
+            {"__tostring", buffer_tostring_lua},
+            {NULL,         NULL               }
+        };
+        struct luaL_Reg method[] = {
+            {"read", buffer_read_lua},
+            {NULL,   NULL           }
+        };
+
+        for (struct luaL_Reg *ptr = mmethod; ptr->name; ptr++) {
+            lauxh_pushfn2tbl(L, ptr->name, ptr->func);
+        }
+        lua_newtable(L);
+        for (struct luaL_Reg *ptr = method; ptr->name; ptr++) {
+            lauxh_pushfn2tbl(L, ptr->name, ptr->func);
+        }
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+    // metatable of the alias table returned by urandom.alias()
+    if (luaL_newmetatable(L, ALIAS_MT)) {
+        struct luaL_Reg mmethod[] = {
+            {"__len",      alias_len_lua     },
+            {"__tostring", alias_tostring_lua},
+            {NULL,         NULL              }
+        };
+
+        for (struct luaL_Reg *ptr = mmethod; ptr->name; ptr++) {
+            lauxh_pushfn2tbl(L, ptr->name, ptr->func);
+        }
+    }
+    lua_pop(L, 1);
+
+#if defined(_WIN32)
+    if (BACKEND == NULL) {
+        init_process();
+    }
+#else
+    // the module may be loaded into the lua_State of several threads at once
+    pthread_once(&INIT_ONCE, init_process);
+#endif
 
     lua_errno_loadlib(L);
-    lua_pushcfunction(L, new_lua);
+    // module table can be called as a function to create an instance
+    lua_createtable(L, 0, 9);
+    lauxh_pushfn2tbl(L, "new", new_lua);
+    lauxh_pushfn2tbl(L, "shared", shared_lua);
+    lauxh_pushfn2tbl(L, "alias", alias_lua);
+    lauxh_pushfn2tbl(L, "buffer", buffer_lua);
+    lauxh_pushfn2tbl(L, "is_instance", is_instance_lua);
+    lauxh_pushfn2tbl(L, "stats", module_stats_lua);
+    lauxh_pushfn2tbl(L, "ready", ready_lua);
+    lauxh_pushfn2tbl(L, "readyfd", readyfd_lua);
+    lauxh_pushbool2tbl(L, "hwrng", HWRNG_AVAILABLE);
+    lua_createtable(L, 0, 1);
+    lauxh_pushfn2tbl(L, "__call", call_lua);
+    lua_setmetatable(L, -2);
     return 1;
 }
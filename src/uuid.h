@@ -0,0 +1,154 @@
+/**
+ *  Copyright (C) 2025 Masatoshi Fukunaga
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef uuid_h
+#define uuid_h
+
+#include "encode.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+/* number of bytes of a UUID and a ULID */
+#define UUID_SIZE 16
+/* number of characters of the formatted UUID and ULID */
+#define UUID_LEN  36
+#define ULID_LEN  26
+
+/**
+ * @brief Get the current Unix time in milliseconds.
+ *
+ * @return uint64_t Returns the number of milliseconds since the Unix epoch.
+ */
+static inline uint64_t uuid_unix_ms(void)
+{
+#if defined(_WIN32)
+    FILETIME ft;
+    uint64_t t = 0;
+
+    GetSystemTimeAsFileTime(&ft);
+    // 100-nanosecond intervals since 1601-01-01
+    t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (t - 116444736000000000ULL) / 10000;
+#else
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_REALTIME, &ts) != 0) {
+        return (uint64_t)time(NULL) * 1000;
+    }
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+/**
+ * @brief Overwrite the first 48 bits with the timestamp in big-endian.
+ *
+ * @param b Pointer to the UUID_SIZE bytes.
+ * @param ms Unix time in milliseconds.
+ */
+static inline void uuid_stamp_ms(uint8_t *b, uint64_t ms)
+{
+    for (int i = 5; i >= 0; i--) {
+        b[i] = (uint8_t)ms;
+        ms >>= 8;
+    }
+}
+
+/**
+ * @brief Stamp the version and the variant of RFC 9562 on the random bytes.
+ *
+ * @param b Pointer to the UUID_SIZE random bytes.
+ * @param version Version of the UUID.
+ */
+static inline void uuid_stamp_version(uint8_t *b, int version)
+{
+    b[6] = (uint8_t)((b[6] & 0x0f) | (version << 4));
+    b[8] = (uint8_t)((b[8] & 0x3f) | 0x80);
+}
+
+/**
+ * @brief Format the UUID as the lowercase hexadecimal string with hyphens.
+ *
+ * @param dst Pointer to the buffer of at least UUID_LEN bytes.
+ * @param b Pointer to the UUID_SIZE bytes.
+ */
+static inline void uuid_format(char *dst, const uint8_t *b)
+{
+    // encode 32 digits at once, then move the groups to open the hyphens
+    // from the last group
+    encode_hex(dst, b, UUID_SIZE);
+    memmove(dst + 24, dst + 20, 12);
+    dst[23] = '-';
+    memmove(dst + 19, dst + 16, 4);
+    dst[18] = '-';
+    memmove(dst + 14, dst + 12, 4);
+    dst[13] = '-';
+    memmove(dst + 9, dst + 8, 4);
+    dst[8] = '-';
+}
+
+/**
+ * @brief Format the ULID in Crockford's base32.
+ *
+ * the 128 bits are encoded from the most significant bit in 26 characters,
+ * so the first character encodes only 3 bits.
+ *
+ * @param dst Pointer to the buffer of at least ULID_LEN bytes.
+ * @param b Pointer to the UUID_SIZE bytes; 48-bit timestamp followed by
+ * 80-bit randomness.
+ */
+static inline void ulid_format(char *dst, const uint8_t *b)
+{
+    static const char chars[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+    uint64_t ts               = 0;
+
+    // 48-bit timestamp in 10 characters
+    for (int i = 0; i < 6; i++) {
+        ts = (ts << 8) | b[i];
+    }
+    for (int i = 9; i >= 0; i--) {
+        dst[i] = chars[ts & 0x1f];
+        ts >>= 5;
+    }
+    // 80-bit randomness in 16 characters; 5 bytes per 8 characters
+    for (int i = 0; i < 2; i++) {
+        const uint8_t *src = b + 6 + i * 5;
+        char *p            = dst + 10 + i * 8;
+        uint64_t v         = 0;
+
+        for (int j = 0; j < 5; j++) {
+            v = (v << 8) | src[j];
+        }
+        for (int j = 7; j >= 0; j--) {
+            p[j] = chars[v & 0x1f];
+            v >>= 5;
+        }
+    }
+}
+
+#endif /* uuid_h */
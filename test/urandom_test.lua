@@ -6,6 +6,76 @@ function testcase.urandom()
     -- test that create a urandom instance
     local u = urandom()
     assert.re_match(u, '^os.urandom: ')
+
+    -- test that create a urandom instance with the chacha20 pool
+    u = urandom({
+        pool = 'chacha20',
+    })
+    assert.re_match(u, '^os.urandom: ')
+
+    -- test that throws error with invalid options
+    local err = assert.throws(urandom, 'foo')
+    assert.match(err, 'table expected, got string')
+    err = assert.throws(urandom, {
+        pool = 1,
+    })
+    assert.match(err, 'pool: string expected, got number')
+    err = assert.throws(urandom, {
+        pool = 'foo',
+    })
+    assert.match(err, 'pool: unknown pool "foo"')
+end
+
+function testcase.new()
+    -- test that create a urandom instance by urandom.new()
+    local u = urandom.new()
+    assert.re_match(u, '^os.urandom: ')
+    assert.is_string(u:bytes(8))
+end
+
+function testcase.module()
+    -- test that the module is a callable table
+    assert.is_table(urandom)
+    assert.is_function(urandom.new)
+    assert.equal(string.find(tostring(urandom()), 'os.urandom: ', 1, true), 1)
+    assert.equal(string.find(tostring(urandom.new()), 'os.urandom: ', 1, true),
+                 1)
+end
+
+function testcase.shared()
+    -- test that returns the same instance
+    local u = urandom.shared()
+    assert.re_match(u, '^os.urandom: ')
+    assert.equal(urandom.shared(), u)
+    assert.not_equal(urandom(), u)
+
+    -- test that the shared instance works after close
+    u:close()
+    assert.equal(#assert(u:bytes(16)), 16)
+    assert.equal(urandom.shared(), u)
+end
+
+function testcase.pool()
+    local u = urandom({
+        pool = 'chacha20',
+    })
+
+    -- test that get bytes from the pool
+    local data = assert(u:bytes(9))
+    assert.equal(#data, 9)
+    -- test that the pool does not repeat its output
+    assert.not_equal(u:bytes(32), u:bytes(32))
+    -- test that get bytes larger than the pool size
+    data = assert(u:bytes(4096))
+    assert.equal(#data, 4096)
+
+    -- test that get integers from the pool
+    local arr = assert(u:get32u(4))
+    assert.equal(#arr, 4)
+    for i = 1, #arr do
+        assert.is_int(arr[i])
+        assert.less(arr[i], 4294967296)
+    end
 end
 
 function testcase.bytes()
@@ -20,6 +90,1121 @@ function testcase.bytes()
     assert.match(err, 'positive integer expected, got no value')
 end
 
+function testcase.threads()
+    for _, opts in ipairs({
+        {},
+        {
+            pool = 'chacha20',
+        },
+    }) do
+        local u = urandom(opts)
+
+        -- test that get the bytes in parallel
+        local nbyte = 4 * 1024 * 1024 + 13
+        local data = assert(u:bytes(nbyte, {
+            threads = 4,
+        }))
+        assert.equal(#data, nbyte)
+        -- test that the bytes are counted once
+        assert.equal(u:stats().bytes, nbyte)
+        -- each region is generated from a different counter range
+        local mib = 1024 * 1024
+        assert.not_equal(data:sub(1, 64), data:sub(mib + 1, mib + 64))
+        assert.not_equal(data:sub(1, 64), string.rep('\0', 64))
+        assert.not_equal(data:sub(-13), string.rep('\0', 13))
+        -- each call uses a new key
+        assert.not_equal(data:sub(1, 64), assert(u:bytes(nbyte, {
+            threads = 4,
+        })):sub(1, 64))
+
+        -- test that small request is generated in the calling thread
+        data = assert(u:bytes(16, {
+            threads = 4,
+        }))
+        assert.equal(#data, 16)
+    end
+
+    -- test that throws error if threads is invalid
+    local u = urandom()
+    local err = assert.throws(u.bytes, u, 16, {
+        threads = -1,
+    })
+    assert.match(err, 'threads: non-negative integer expected')
+    err = assert.throws(u.bytes, u, 16, {
+        threads = 'foo',
+    })
+    assert.match(err, 'threads: number expected, got string')
+    err = assert.throws(u.bytes, u, 16, 'foo')
+    assert.match(err, 'table expected, got string')
+end
+
+function testcase.buffer()
+    for _, opts in ipairs({
+        {
+            buffer = 64,
+        },
+        {
+            buffer = 64,
+            pool = 'chacha20',
+        },
+    }) do
+        local u = urandom(opts)
+
+        -- test that get the bytes smaller than the buffer
+        local prev = assert(u:bytes(8))
+        for _ = 1, 20 do
+            local data = assert(u:bytes(8))
+            assert.equal(#data, 8)
+            assert.not_equal(data, prev)
+            prev = data
+        end
+
+        -- test that get the bytes across the refill of the buffer
+        local data = assert(u:bytes(60))
+        assert.equal(#data, 60)
+
+        -- test that get the bytes larger than the buffer
+        data = assert(u:bytes(1024))
+        assert.equal(#data, 1024)
+
+        -- test that get the integers from the buffer
+        assert.is_int(u:u32())
+        assert.equal(#assert(u:get32u(4)), 4)
+    end
+
+    -- test that throws error with invalid buffer size
+    local err = assert.throws(urandom, {
+        buffer = -1,
+    })
+    assert.match(err, 'buffer: non-negative integer expected')
+    err = assert.throws(urandom, {
+        buffer = 'foo',
+    })
+    assert.match(err, 'buffer: number expected, got string')
+end
+
+function testcase.prefetch()
+    for _, opts in ipairs({
+        {
+            buffer = 64,
+            prefetch = 4,
+        },
+        {
+            buffer = 64,
+            prefetch = 4,
+            pool = 'chacha20',
+        },
+        {
+            buffer = 64,
+            prefetch = 4,
+            pool = 'chacha20',
+            hwrng = true,
+        },
+        {
+            buffer = 8192,
+            prefetch = 4,
+            backend = urandom():backend(),
+        },
+    }) do
+        local u = assert(urandom(opts))
+
+        -- test that get the bytes from the prefetched blocks
+        local uniq = {}
+        for _ = 1, 100 do
+            local data = assert(u:bytes(16))
+            assert.equal(#data, 16)
+            assert.is_nil(uniq[data])
+            uniq[data] = true
+        end
+        -- test that get the bytes larger than the block
+        assert.equal(#assert(u:bytes(256)), 256)
+
+        -- test that the reads of the producer thread are counted
+        local stats = u:stats()
+        assert.greater_or_equal(stats.os_calls, 1)
+        if opts.pool then
+            assert.greater_or_equal(stats.reseeds, 1)
+        end
+        u = nil
+        collectgarbage('collect')
+    end
+
+    -- test that throws error with invalid options
+    local err = assert.throws(urandom, {
+        prefetch = 4,
+    })
+    assert.match(err, 'prefetch: requires the buffer option')
+    err = assert.throws(urandom, {
+        buffer = 64,
+        prefetch = -1,
+    })
+    assert.match(err, 'prefetch: non-negative integer expected')
+end
+
+function testcase.seed()
+    -- test that the instances with the same seed return the same results
+    local a = assert(urandom({
+        seed = 'load-test',
+    }))
+    local b = assert(urandom({
+        seed = 'load-test',
+    }))
+    assert.equal(a:hex(16), 'd731d21e9758da0279c9a58751808843')
+    assert.equal(b:hex(16), 'd731d21e9758da0279c9a58751808843')
+    assert.equal(a:bytes(2000), b:bytes(2000))
+    assert.equal(a:get32u(100), b:get32u(100))
+    assert.equal(a:range(1, 6, 10), b:range(1, 6, 10))
+    assert.equal(a:double(), b:double())
+    assert.equal(a:bytes(2 * 1024 * 1024), b:bytes(2 * 1024 * 1024))
+
+    -- test that the different seeds return the different results
+    local c = assert(urandom({
+        seed = 'load-tesu',
+    }))
+    assert.not_equal(c:hex(16), 'd731d21e9758da0279c9a58751808843')
+
+    -- test that the read-ahead buffer is also reproducible
+    a = assert(urandom({
+        seed = 'load-test',
+        buffer = 64,
+    }))
+    b = assert(urandom({
+        seed = 'load-test',
+        buffer = 64,
+    }))
+    for _ = 1, 10 do
+        assert.equal(a:bytes(7), b:bytes(7))
+    end
+
+    -- test that the seeded instance is distinguishable
+    assert.equal(string.find(tostring(a), 'os.urandom.seeded: ', 1, true), 1)
+    assert.equal(a:backend(), 'seed')
+    assert.equal(string.find(tostring(urandom()), 'os.urandom: ', 1, true),
+                 1)
+
+    -- test that throws error with the conflicting options
+    for _, k in ipairs({
+        'prefetch',
+        'secure',
+        'hwrng',
+        'backend',
+    }) do
+        local opts = {
+            seed = 'x',
+            buffer = 64,
+            pool = 'chacha20',
+        }
+        opts[k] = k == 'prefetch' and 4 or k == 'backend' and 'auto' or true
+        local err = assert.throws(urandom, opts)
+        assert.match(err, k .. ': cannot be used with the seed option')
+    end
+    local err = assert.throws(urandom, {
+        seed = 1,
+    })
+    assert.match(err, 'seed: string expected')
+end
+
+function testcase.mmap()
+    for _, opts in ipairs({
+        {
+            mmap = 4096,
+        },
+        {
+            mmap = 4096,
+            hugepage = true,
+        },
+        {
+            mmap = 0,
+        },
+    }) do
+        local u = urandom(opts)
+
+        -- test that get the bytes larger than the threshold
+        local data = assert(u:bytes(8192))
+        assert.equal(#data, 8192)
+        assert.not_equal(data, u:bytes(8192))
+        -- test that get the bytes smaller than the threshold after that
+        assert.equal(#assert(u:bytes(16)), 16)
+        assert.equal(#assert(u:hex(8192)), 16384)
+        assert.equal(#assert(u:get64u(1024)), 1024)
+
+        -- test that the large buffer is reused while the sizes alternate
+        assert.equal(#assert(u:bytes(16384)), 16384)
+        local grows = u:stats().grows
+        for _ = 1, 10 do
+            assert.equal(#assert(u:bytes(16)), 16)
+            assert.equal(#assert(u:bytes(16384)), 16384)
+        end
+        assert.equal(u:stats().grows, grows)
+        -- test that the large buffer is released after many small requests
+        for _ = 1, 64 do
+            assert.equal(#assert(u:bytes(16)), 16)
+        end
+        assert.equal(#assert(u:bytes(16384)), 16384)
+        if opts.mmap > 0 then
+            -- the small buffer and the large buffer are allocated again
+            assert.equal(u:stats().grows, grows + 2)
+        else
+            assert.equal(u:stats().grows, grows)
+        end
+
+        -- test that the buffer is allocated again after shrink
+        u:shrink()
+        assert.equal(#assert(u:bytes(8192)), 8192)
+        u:shrink()
+        u:shrink()
+        assert.equal(#assert(u:bytes(16)), 16)
+    end
+
+    -- test that throws error with invalid options
+    local err = assert.throws(urandom, {
+        mmap = -1,
+    })
+    assert.match(err, 'mmap: non-negative integer expected')
+    err = assert.throws(urandom, {
+        hugepage = 'foo',
+    })
+    assert.match(err, 'hugepage: boolean expected, got string')
+end
+
+function testcase.secure()
+    for _, opts in ipairs({
+        {
+            secure = true,
+        },
+        {
+            secure = true,
+            pool = 'chacha20',
+            buffer = 64,
+        },
+        {
+            secure = true,
+            pool = 'chacha20',
+            buffer = 64,
+            prefetch = 4,
+        },
+    }) do
+        local u = assert(urandom(opts))
+
+        -- test that get the random values from the locked buffer
+        local data = assert(u:bytes(32))
+        assert.equal(#data, 32)
+        assert.not_equal(data, u:bytes(32))
+        assert.equal(#assert(u:hex(16)), 32)
+        assert.equal(#assert(u:tokens(4, 8)), 4)
+        assert.equal(#assert(u:get32u(8)), 8)
+        assert.is_number(u:double())
+        assert.is_int(u:range(1, 6))
+        assert.is_int(u:u64())
+
+        -- test that the instance works after the buffer is wiped by close
+        u:close()
+        data = assert(u:bytes(32))
+        assert.equal(#data, 32)
+        assert.not_equal(data, string.rep('\0', 32))
+    end
+
+    -- test that throws error with invalid option
+    local err = assert.throws(urandom, {
+        secure = 'foo',
+    })
+    assert.match(err, 'secure: boolean expected, got string')
+end
+
+function testcase.hwrng()
+    -- test that urandom.hwrng is a boolean
+    assert.is_boolean(urandom.hwrng)
+
+    -- test that the pool works with the hardware RNG
+    local u = assert(urandom({
+        pool = 'chacha20',
+        hwrng = true,
+    }))
+    local data = assert(u:bytes(32))
+    assert.equal(#data, 32)
+    assert.not_equal(data, u:bytes(32))
+
+    -- test that throws error without the pool option
+    local err = assert.throws(urandom, {
+        hwrng = true,
+    })
+    assert.match(err, 'hwrng: requires the pool option')
+    err = assert.throws(urandom, {
+        pool = 'chacha20',
+        hwrng = 1,
+    })
+    assert.match(err, 'hwrng: boolean expected, got number')
+end
+
+function testcase.stats()
+    local u = urandom({
+        pool = 'chacha20',
+        buffer = 64,
+    })
+
+    -- test that all counters are zero on a new instance
+    local stats = u:stats()
+    assert.equal(stats.calls.bytes, 0)
+    assert.equal(stats.bytes, 0)
+    assert.equal(stats.os_calls, 0)
+    assert.equal(stats.os_time, 0)
+    assert.is_table(stats.fallbacks)
+
+    -- test that the counters are updated by the methods
+    local before = urandom.stats()
+    assert(u:bytes(8))
+    assert(u:bytes(16))
+    assert(u:get32u(4))
+    assert(u:u32())
+    stats = u:stats()
+    assert.equal(stats.calls.bytes, 2)
+    assert.equal(stats.calls.get32u, 1)
+    assert.equal(stats.calls.u32, 1)
+    assert.equal(stats.calls.hex, 0)
+    assert.equal(stats.bytes, 8 + 16 + 16 + 4)
+    assert.equal(stats.reseeds, 1)
+    assert.equal(stats.os_calls, 1)
+    assert.greater_or_equal(stats.refills, 1)
+    assert.greater_or_equal(stats.grows, 1)
+    assert.greater_or_equal(stats.os_time, 0)
+    assert.equal(stats.os_errors, 0)
+
+    -- test that the module counters include all instances
+    local after = urandom.stats()
+    assert.equal(after.calls.bytes - before.calls.bytes, 2)
+    assert.equal(after.bytes - before.bytes, stats.bytes)
+    assert.equal(after.os_calls - before.os_calls, 1)
+
+    -- test that the reads from the OS are counted without the pool
+    u = urandom()
+    assert(u:bytes(16))
+    stats = u:stats()
+    assert.equal(stats.os_calls, 1)
+    assert.equal(stats.bytes, 16)
+end
+
+function testcase.nonblock()
+    -- test that the kernel RNG is initialized on the test host
+    assert.is_true(urandom.ready())
+
+    -- test that get bytes in nonblocking mode
+    local u = urandom({
+        nonblock = true,
+    })
+    assert.equal(#assert(u:bytes(16)), 16)
+    assert.equal(#assert(u:get32u(4)), 4)
+    u = urandom()
+    assert.equal(#assert(u:bytes(16, {
+        nonblock = true,
+    })), 16)
+
+    -- test that returns the pollable file descriptor
+    local fd = assert(urandom.readyfd())
+    assert.is_int(fd)
+    assert.equal(urandom.readyfd(), fd)
+
+    -- test that throws error with invalid option
+    local err = assert.throws(urandom, {
+        nonblock = 1,
+    })
+    assert.match(err, 'nonblock: boolean expected, got number')
+    err = assert.throws(u.bytes, u, 16, {
+        nonblock = 1,
+    })
+    assert.match(err, 'nonblock: boolean expected, got number')
+end
+
+function testcase.backend()
+    local u = urandom()
+    local known = {
+        openssl = true,
+        arc4random = true,
+        getrandom = true,
+        getentropy = true,
+        urandom = true,
+        bcrypt = true,
+    }
+
+    -- test that returns the name of the selected backend
+    local name = assert(u:backend())
+    assert.is_string(name)
+    assert(known[name], 'unknown backend: ' .. name)
+
+    -- test that all instances share the backend selected at load time
+    assert.equal(urandom():backend(), name)
+
+    -- test that auto uses the backend selected at load time
+    u = assert(urandom({
+        backend = 'auto',
+    }))
+    assert.equal(u:backend(), name)
+
+    -- test that use the specified backend
+    u = assert(urandom({
+        backend = name,
+    }))
+    assert.equal(u:backend(), name)
+    assert.equal(#assert(u:bytes(16)), 16)
+    assert.equal(#assert(u:bytes(8192)), 8192)
+
+    -- test that the fastest backends are selected for small and large reads
+    u = assert(urandom({
+        backend = 'fastest',
+    }))
+    local small, large = u:backend()
+    assert.is_string(small)
+    assert(known[small], 'unknown backend: ' .. small)
+    if large ~= nil then
+        -- large is returned only if it differs from small
+        assert(known[large], 'unknown backend: ' .. large)
+        assert.not_equal(large, small)
+    end
+    if name == 'openssl' then
+        -- test that only openssl is measured if it is mandatory
+        assert.equal(small, 'openssl')
+        assert.is_nil(large)
+    end
+    assert.equal(#assert(u:bytes(16)), 16)
+    assert.equal(#assert(u:bytes(8192)), 8192)
+    -- test that the calibration result is cached
+    local small2, large2 = urandom({
+        backend = 'fastest',
+    }):backend()
+    assert.equal(small2, small)
+    assert.equal(large2, large)
+
+    -- test that returns an error if the backend does not work
+    local err
+    for _, v in ipairs({
+        'openssl',
+        'arc4random',
+        'getrandom',
+        'getentropy',
+        'urandom',
+    }) do
+        u, err = urandom({
+            backend = v,
+        })
+        if u then
+            assert.equal(u:backend(), v)
+        else
+            assert.match(err, 'ENOSYS')
+        end
+    end
+
+    -- test that throws error with unknown backend
+    err = assert.throws(urandom, {
+        backend = 'foo',
+    })
+    assert.match(err, 'backend: unknown backend "foo"')
+end
+
+function testcase.urandom_buffer()
+    -- test that create a zero-filled buffer
+    local buf = urandom.buffer(16)
+    assert.equal(#buf, 16)
+    assert.equal(buf:read(), string.rep('\0', 16))
+    assert.equal(buf:read(4), string.rep('\0', 12))
+    assert.equal(buf:read(4, 2), '\0\0')
+    assert.equal(string.find(tostring(buf), 'os.urandom.buffer: ', 1, true), 1)
+
+    -- test that throws error if the range exceeds the size of the buffer
+    local err = assert.throws(buf.read, buf, 17)
+    assert.match(err, 'offset out of range')
+    err = assert.throws(buf.read, buf, 8, 9)
+    assert.match(err, 'length out of range')
+
+    -- test that throws error if size is not positive
+    err = assert.throws(urandom.buffer, 0)
+    assert.match(err, 'positive integer expected')
+end
+
+function testcase.fill()
+    local u = urandom()
+    local buf = urandom.buffer(64)
+    local zero = string.rep('\0', 64)
+
+    -- test that fill random bytes into the buffer
+    assert.is_true(u:fill(buf))
+    assert.not_equal(buf:read(), zero)
+
+    -- test that fill only the specified range of the buffer
+    buf = urandom.buffer(64)
+    assert.is_true(u:fill(buf, 16, 32))
+    assert.equal(buf:read(0, 16), string.rep('\0', 16))
+    assert.not_equal(buf:read(16, 32), string.rep('\0', 32))
+    assert.equal(buf:read(48), string.rep('\0', 16))
+
+    -- test that fill zero bytes into the buffer
+    buf = urandom.buffer(8)
+    assert.is_true(u:fill(buf, 0, 0))
+    assert.is_true(u:fill(buf, 8))
+    assert.equal(buf:read(), string.rep('\0', 8))
+
+    -- test that throws error if the range exceeds the size of the userdata
+    local err = assert.throws(u.fill, u, buf, 0, 1024)
+    assert.match(err, 'length out of range')
+    err = assert.throws(u.fill, u, buf, 1024)
+    assert.match(err, 'offset out of range')
+    err = assert.throws(u.fill, u, buf, -1)
+    assert.match(err, 'offset out of range')
+
+    -- test that throws error if dst is a userdata with other metatable
+    local f = assert(io.tmpfile())
+    err = assert.throws(u.fill, u, f)
+    assert.match(err, 'userdata without metatable or os.urandom.buffer')
+    err = assert.throws(u.fill, u, u)
+    assert.match(err, 'userdata without metatable or os.urandom.buffer')
+    f:close()
+
+    -- test that throws error if dst is not a userdata
+    err = assert.throws(u.fill, u, 'foo')
+    assert.match(err, 'userdata expected, got string')
+end
+
+function testcase.write_to()
+    local u = urandom()
+    local f = assert(io.tmpfile())
+
+    -- test that write the random bytes to the file in chunks
+    assert(f:write('foo'))
+    local n = assert(u:write_to(f, 1000, 64))
+    assert.equal(n, 1000)
+    -- test that the buffered data of the file is written first
+    assert(f:seek('set'))
+    local data = assert(f:read('*a'))
+    assert.equal(#data, 1003)
+    assert.equal(data:sub(1, 3), 'foo')
+
+    -- test that write zero bytes
+    n = assert(u:write_to(f, 0))
+    assert.equal(n, 0)
+
+    -- test that return an error if fd is invalid
+    local err
+    n, err = u:write_to(999999, 16)
+    assert.is_nil(n)
+    assert.match(err, 'EBADF')
+
+    -- test that throws error if arguments are invalid
+    err = assert.throws(u.write_to, u, f, -1)
+    assert.match(err, 'non-negative integer expected')
+    err = assert.throws(u.write_to, u, f, 16, 0)
+    assert.match(err, 'positive integer expected')
+    err = assert.throws(u.write_to, u, -1, 16)
+    assert.match(err, 'invalid file descriptor')
+    err = assert.throws(u.write_to, u, 'foo', 16)
+    assert.match(err, 'FILE* expected')
+    f:close()
+    err = assert.throws(u.write_to, u, f, 16)
+    assert.match(err, 'closed file')
+end
+
+function testcase.tokens()
+    local u = urandom()
+
+    -- test that get 4 tokens of 16 bytes
+    local arr = assert(u:tokens(4, 16))
+    assert.equal(#arr, 4)
+    for i = 1, #arr do
+        assert.is_string(arr[i])
+        assert.equal(#arr[i], 16)
+    end
+    assert.not_equal(arr[1], arr[2])
+
+    -- test that fill tokens into the specified table
+    local t = {
+        'foo',
+    }
+    arr = assert(u:tokens(2, 8, nil, t))
+    assert.equal(arr, t)
+    assert.equal(#t, 2)
+    assert.equal(#t[1], 8)
+    assert.equal(#t[2], 8)
+
+    -- test that returns error for count overflow
+    local data, err = u:tokens(0x7FFFFFFF + 1, 1)
+    assert.is_nil(data)
+    assert.match(err, 'ERANGE')
+
+    -- test that get encoded tokens
+    for encoding, pattern in pairs({
+        hex = '^[0-9a-f]+$',
+        base64 = '^[A-Za-z0-9+/]+=*$',
+        base64url = '^[A-Za-z0-9_-]+$',
+    }) do
+        arr = assert(u:tokens(3, 16, encoding))
+        assert.equal(#arr, 3)
+        for i = 1, #arr do
+            assert.re_match(arr[i], pattern)
+        end
+    end
+    arr = assert(u:tokens(2, 16, 'hex'))
+    assert.equal(#arr[1], 32)
+    arr = assert(u:tokens(2, 16, 'base64'))
+    assert.equal(#arr[1], 24)
+    arr = assert(u:tokens(2, 16, 'base64url'))
+    assert.equal(#arr[1], 22)
+
+    -- test that throws error with unknown encoding
+    err = assert.throws(u.tokens, u, 1, 1, 'foo')
+    assert.match(err, "invalid option 'foo'")
+
+    -- test that throws error with no argument
+    err = assert.throws(u.tokens, u)
+    assert.match(err, 'positive integer expected, got no value')
+end
+
+function testcase.hex()
+    local u = urandom()
+
+    -- test that get N bytes as hex string
+    for _, n in ipairs({
+        1,
+        15,
+        16,
+        33,
+    }) do
+        local s = assert(u:hex(n))
+        assert.equal(#s, n * 2)
+        assert.re_match(s, '^[0-9a-f]+$')
+    end
+
+    -- test that throws error with no argument
+    local err = assert.throws(u.hex, u)
+    assert.match(err, 'positive integer expected, got no value')
+end
+
+function testcase.base64()
+    local u = urandom()
+
+    -- test that get N bytes as base64 string
+    for n, len in pairs({
+        [1] = 4,
+        [2] = 4,
+        [3] = 4,
+        [16] = 24,
+        [32] = 44,
+    }) do
+        local s = assert(u:base64(n))
+        assert.equal(#s, len)
+        assert.re_match(s, '^[A-Za-z0-9+/]+=*$')
+    end
+
+    -- test that throws error with no argument
+    local err = assert.throws(u.base64, u)
+    assert.match(err, 'positive integer expected, got no value')
+end
+
+function testcase.base64url()
+    local u = urandom()
+
+    -- test that get N bytes as base64url string without padding
+    for n, len in pairs({
+        [1] = 2,
+        [2] = 3,
+        [3] = 4,
+        [16] = 22,
+        [32] = 43,
+    }) do
+        local s = assert(u:base64url(n))
+        assert.equal(#s, len)
+        assert.re_match(s, '^[A-Za-z0-9_-]+$')
+    end
+
+    -- test that throws error with no argument
+    local err = assert.throws(u.base64url, u)
+    assert.match(err, 'positive integer expected, got no value')
+end
+
+function testcase.uuid4()
+    local u = urandom()
+
+    -- test that get a UUID of version 4
+    local pattern = '^%x%x%x%x%x%x%x%x%-%x%x%x%x%-4%x%x%x%-[89ab]%x%x%x%-' ..
+                        string.rep('%x', 12) .. '$'
+    local s = assert(u:uuid4())
+    assert(string.find(s, pattern), 'invalid uuid ' .. s)
+    assert.equal(s, string.lower(s))
+
+    -- test that get the distinct UUIDs
+    local arr = assert(u:uuid4(100))
+    assert.equal(#arr, 100)
+    local seen = {}
+    for i = 1, #arr do
+        assert(string.find(arr[i], pattern), 'invalid uuid ' .. arr[i])
+        assert.is_nil(seen[arr[i]])
+        seen[arr[i]] = true
+    end
+
+    -- test that returns error for count overflow
+    local err
+    arr, err = u:uuid4(0x7FFFFFFF + 1)
+    assert.is_nil(arr)
+    assert.match(err, 'ERANGE')
+end
+
+function testcase.uuid7()
+    local u = urandom()
+
+    -- test that get a UUID of version 7 with the current timestamp
+    local pattern = '^(%x%x%x%x%x%x%x%x)%-(%x%x%x%x)%-7%x%x%x%-[89ab]%x%x%x%-' ..
+                        string.rep('%x', 12) .. '$'
+    local before = os.time()
+    local arr = assert(u:uuid7(10))
+    local after = os.time()
+    assert.equal(#arr, 10)
+    local seen = {}
+    for i = 1, #arr do
+        local hi, lo = string.match(arr[i], pattern)
+        assert(hi, 'invalid uuid ' .. arr[i])
+        local sec = math.floor((tonumber(hi, 16) * 65536 + tonumber(lo, 16)) /
+                                   1000)
+        assert.greater_or_equal(sec, before - 1)
+        assert.less_or_equal(sec, after + 1)
+        assert.is_nil(seen[arr[i]])
+        seen[arr[i]] = true
+    end
+    assert(string.find(assert(u:uuid7()), pattern))
+end
+
+function testcase.ulid()
+    local u = urandom()
+
+    -- test that get a ULID with the current timestamp
+    local chars = '0123456789ABCDEFGHJKMNPQRSTVWXYZ'
+    local before = os.time()
+    local arr = assert(u:ulid(10))
+    local after = os.time()
+    assert.equal(#arr, 10)
+    local seen = {}
+    for i = 1, #arr do
+        local s = arr[i]
+        assert.equal(#s, 26)
+        local ms = 0
+        for j = 1, 26 do
+            local v = string.find(chars, string.sub(s, j, j), 1, true)
+            assert(v, 'invalid ulid ' .. s)
+            if j <= 10 then
+                ms = ms * 32 + (v - 1)
+            end
+        end
+        assert.greater_or_equal(math.floor(ms / 1000), before - 1)
+        assert.less_or_equal(math.floor(ms / 1000), after + 1)
+        assert.is_nil(seen[s])
+        seen[s] = true
+    end
+    assert.equal(#assert(u:ulid()), 26)
+end
+
+function testcase.range()
+    local u = urandom()
+
+    -- test that get an integer in [lo, hi]
+    local v = assert(u:range(1, 6))
+    assert.is_int(v)
+    assert.greater_or_equal(v, 1)
+    assert.less_or_equal(v, 6)
+    assert.equal(u:range(3, 3), 3)
+
+    -- test that get 1000 integers in [lo, hi]
+    local arr = assert(u:range(-3, 3, 1000))
+    assert.equal(#arr, 1000)
+    local seen = {}
+    for i = 1, #arr do
+        assert.is_int(arr[i])
+        assert.greater_or_equal(arr[i], -3)
+        assert.less_or_equal(arr[i], 3)
+        seen[arr[i]] = true
+    end
+    for i = -3, 3 do
+        assert(seen[i], 'value ' .. i .. ' never appeared')
+    end
+
+    -- test that get an integer in the range larger than 32 bits
+    arr = assert(u:range(0, 0x1FFFFFFFFFFF, 10))
+    for i = 1, #arr do
+        assert.greater_or_equal(arr[i], 0)
+        assert.less_or_equal(arr[i], 0x1FFFFFFFFFFF)
+    end
+    if math.maxinteger then
+        -- test that get an integer in the full 64-bit range
+        assert.is_int(u:range(math.mininteger, math.maxinteger))
+    end
+
+    -- test that throws error if hi is less than lo
+    local err = assert.throws(u.range, u, 2, 1)
+    assert.match(err, 'hi must be greater than or equal to lo')
+
+    -- test that returns error for count overflow
+    local data
+    data, err = u:range(1, 2, 0x7FFFFFFF + 1)
+    assert.is_nil(data)
+    assert.match(err, 'ERANGE')
+end
+
+function testcase.shuffle()
+    local u = urandom()
+
+    -- test that shuffle the elements in place
+    local t = {}
+    for i = 1, 100 do
+        t[i] = i
+    end
+    assert.equal(assert(u:shuffle(t)), t)
+    assert.equal(#t, 100)
+    local seen = {}
+    local moved = false
+    for i = 1, 100 do
+        assert.is_nil(seen[t[i]])
+        seen[t[i]] = true
+        moved = moved or t[i] ~= i
+    end
+    assert(moved, 'elements are never moved')
+
+    -- test that shuffle only the elements in [i, j]
+    t = {}
+    for i = 1, 10 do
+        t[i] = i
+    end
+    assert(u:shuffle(t, 3, 7))
+    for _, i in ipairs({1, 2, 8, 9, 10}) do
+        assert.equal(t[i], i)
+    end
+    seen = {}
+    for i = 3, 7 do
+        assert.greater_or_equal(t[i], 3)
+        assert.less_or_equal(t[i], 7)
+        assert.is_nil(seen[t[i]])
+        seen[t[i]] = true
+    end
+
+    -- test that all permutations appear
+    seen = {}
+    for _ = 1, 600 do
+        t = assert(u:shuffle({'a', 'b', 'c'}))
+        seen[table.concat(t)] = true
+    end
+    for _, v in ipairs({'abc', 'acb', 'bac', 'bca', 'cab', 'cba'}) do
+        assert(seen[v], 'permutation ' .. v .. ' never appeared')
+    end
+
+    -- test that nothing is done for the empty range
+    assert.equal(assert(u:shuffle({})), {})
+    assert.equal(assert(u:shuffle({1, 2, 3}, 3, 2)), {1, 2, 3})
+
+    -- test that throws error with invalid arguments
+    local err = assert.throws(u.shuffle, u)
+    assert.match(err, 'table expected')
+    err = assert.throws(u.shuffle, u, {1, 2}, 0)
+    assert.match(err, 'i must be greater than or equal to 1')
+end
+
+function testcase.permutation()
+    local u = urandom()
+
+    -- test that get a permutation of 1..n
+    local arr = assert(u:permutation(100))
+    assert.equal(#arr, 100)
+    local seen = {}
+    for i = 1, 100 do
+        assert.is_int(arr[i])
+        assert.greater_or_equal(arr[i], 1)
+        assert.less_or_equal(arr[i], 100)
+        assert.is_nil(seen[arr[i]])
+        seen[arr[i]] = true
+    end
+    assert.equal(assert(u:permutation(0)), {})
+    assert.equal(assert(u:permutation(1)), {1})
+
+    -- test that all permutations appear
+    seen = {}
+    for _ = 1, 600 do
+        seen[table.concat(assert(u:permutation(3)))] = true
+    end
+    for _, v in ipairs({'123', '132', '213', '231', '312', '321'}) do
+        assert(seen[v], 'permutation ' .. v .. ' never appeared')
+    end
+
+    -- test that throws error with negative n
+    local err = assert.throws(u.permutation, u, -1)
+    assert.match(err, 'n must be greater than or equal to 0')
+
+    -- test that returns error for n overflow
+    arr, err = u:permutation(0x7FFFFFFF + 1)
+    assert.is_nil(arr)
+    assert.match(err, 'ERANGE')
+end
+
+function testcase.choice()
+    local u = urandom()
+    local t = {
+        'a',
+        'b',
+        'c',
+        'd',
+    }
+
+    -- test that choose an element
+    local seen = {}
+    for _ = 1, 400 do
+        local v = assert(u:choice(t))
+        seen[v] = true
+    end
+    for _, v in ipairs(t) do
+        assert(seen[v], 'element ' .. v .. ' never appeared')
+    end
+
+    -- test that choose k distinct elements
+    for _ = 1, 100 do
+        local arr = assert(u:choice(t, 3))
+        assert.equal(#arr, 3)
+        seen = {}
+        for i = 1, 3 do
+            assert(string.find('abcd', arr[i], 1, true),
+                   'unexpected element ' .. tostring(arr[i]))
+            assert.is_nil(seen[arr[i]])
+            seen[arr[i]] = true
+        end
+    end
+    local arr = assert(u:choice(t, 4))
+    table.sort(arr)
+    assert.equal(arr, t)
+
+    -- test that throws error with invalid arguments
+    local err = assert.throws(u.choice, u, {})
+    assert.match(err, 't must not be empty')
+    err = assert.throws(u.choice, u, t, 5)
+    assert.match(err, 'k must be less than or equal to #t')
+    err = assert.throws(u.choice, u, t, 0)
+    assert.match(err, 'positive integer expected')
+end
+
+function testcase.weighted_choice()
+    local u = urandom()
+    local weights = {
+        1,
+        0,
+        3,
+    }
+
+    -- test that choose indexes in proportion to the weights
+    for _, w in ipairs({
+        weights,
+        urandom.alias(weights),
+    }) do
+        local arr = assert(u:weighted_choice(w, 4000))
+        assert.equal(#arr, 4000)
+        local count = {
+            0,
+            0,
+            0,
+        }
+        for i = 1, #arr do
+            count[arr[i]] = count[arr[i]] + 1
+        end
+        assert.equal(count[2], 0)
+        assert.greater(count[1], 800)
+        assert.less(count[1], 1200)
+        assert.equal(count[1] + count[3], 4000)
+
+        local v = assert(u:weighted_choice(w))
+        assert(v == 1 or v == 3, 'unexpected index ' .. tostring(v))
+    end
+
+    -- test that the alias table is reusable
+    local a = urandom.alias(weights)
+    assert.equal(#a, 3)
+    assert.equal(string.find(tostring(a), 'os.urandom.alias: ', 1, true), 1)
+    assert.equal(assert(u:weighted_choice(urandom.alias({
+        0,
+        5,
+    }))), 2)
+
+    -- test that throws error with invalid weights
+    for _, v in ipairs({
+        {},
+        {
+            1,
+            -1,
+        },
+        {
+            1,
+            'a',
+        },
+        {
+            0,
+            0,
+        },
+        {
+            1 / 0,
+        },
+    }) do
+        assert.throws(urandom.alias, v)
+        assert.throws(u.weighted_choice, u, v)
+    end
+    local err = assert.throws(u.weighted_choice, u, u)
+    assert.match(err, 'os.urandom.alias expected')
+end
+
+function testcase.reservoir()
+    local u = urandom({
+        pool = 'chacha20',
+    })
+    local function range(n)
+        local i = 0
+        return function()
+            if i < n then
+                i = i + 1
+                return i
+            end
+        end
+    end
+
+    -- test that choose k distinct elements of the stream
+    local count = {}
+    for _ = 1, 1000 do
+        local arr = assert(u:reservoir(range(20), 5))
+        assert.equal(#arr, 5)
+        local seen = {}
+        for i = 1, 5 do
+            assert.is_nil(seen[arr[i]])
+            seen[arr[i]] = true
+            count[arr[i]] = (count[arr[i]] or 0) + 1
+        end
+    end
+    -- each element is chosen with probability 5/20
+    for i = 1, 20 do
+        assert.greater(count[i], 150)
+        assert.less(count[i], 350)
+    end
+
+    -- test that return all elements of the short stream
+    local arr = assert(u:reservoir(range(3), 5))
+    assert.equal(arr, {
+        1,
+        2,
+        3,
+    })
+    assert.equal(assert(u:reservoir(range(0), 5)), {})
+
+    -- test that the iterator can use the same instance
+    local n = 0
+    arr = assert(u:reservoir(function()
+        if n < 100 then
+            n = n + 1
+            return assert(u:hex(4))
+        end
+    end, 10))
+    assert.equal(#arr, 10)
+
+    -- test that throws error with invalid arguments
+    local err = assert.throws(u.reservoir, u, {})
+    assert.match(err, 'function expected')
+    err = assert.throws(u.reservoir, u, range(1), 0)
+    assert.match(err, 'positive integer expected')
+end
+
 function testcase.get8u()
     local u = urandom()
 
@@ -63,6 +1248,185 @@ function testcase.get32u()
     end
 end
 
+function testcase.get64u()
+    local u = urandom()
+
+    -- test that get as uint64 array
+    local arr = assert(u:get64u(4))
+    assert.equal(#arr, 4)
+    for i = 1, #arr do
+        if math.type then
+            -- values above math.maxinteger wrap around to negative values
+            assert.is_int(arr[i])
+        else
+            -- reduced to 53 bits without 64-bit integers
+            assert.greater_or_equal(arr[i], 0)
+            assert.less(arr[i], 2 ^ 53)
+        end
+    end
+end
+
+function testcase.signed()
+    local u = urandom()
+
+    -- test that get as signed integer array
+    for method, range in pairs({
+        get8i = 2 ^ 7,
+        get16i = 2 ^ 15,
+        get32i = 2 ^ 31,
+        get64i = math.type and 2 ^ 63 or 2 ^ 53,
+    }) do
+        local arr = assert(u[method](u, 64))
+        assert.equal(#arr, 64)
+        local negative = false
+        for i = 1, #arr do
+            assert.greater_or_equal(arr[i], -range)
+            assert.less(arr[i], range)
+            negative = negative or arr[i] < 0
+        end
+        assert(negative, method .. ' returns no negative values')
+
+        -- test that throws error with no argument
+        local err = assert.throws(u[method], u)
+        assert.match(err, 'positive integer expected, got no value')
+    end
+end
+
+function testcase.double()
+    local u = urandom()
+
+    for _, method in ipairs({
+        'double',
+        'float',
+    }) do
+        -- test that get a number in [0, 1)
+        local v = assert(u[method](u))
+        assert.is_number(v)
+        assert.greater_or_equal(v, 0)
+        assert.less(v, 1)
+
+        -- test that get 1000 numbers in [0, 1)
+        local arr = assert(u[method](u, 1000))
+        assert.equal(#arr, 1000)
+        local sum = 0
+        for i = 1, #arr do
+            assert.greater_or_equal(arr[i], 0)
+            assert.less(arr[i], 1)
+            sum = sum + arr[i]
+        end
+        -- mean of the uniform distribution is 0.5
+        assert.greater(sum / #arr, 0.4)
+        assert.less(sum / #arr, 0.6)
+
+        -- test that returns error for count overflow
+        local data, err = u[method](u, 0x7FFFFFFF + 1)
+        assert.is_nil(data)
+        assert.match(err, 'ERANGE')
+    end
+end
+
+function testcase.single_value()
+    for _, u in ipairs({
+        urandom(),
+        urandom({
+            pool = 'chacha20',
+        }),
+    }) do
+        -- test that get a single integer without table
+        for method, range in pairs({
+            u8 = {
+                0,
+                2 ^ 8,
+            },
+            u16 = {
+                0,
+                2 ^ 16,
+            },
+            u32 = {
+                0,
+                2 ^ 32,
+            },
+            u64 = {
+                math.type and -2 ^ 63 or 0,
+                math.type and 2 ^ 63 or 2 ^ 53,
+            },
+            i8 = {
+                -2 ^ 7,
+                2 ^ 7,
+            },
+            i16 = {
+                -2 ^ 15,
+                2 ^ 15,
+            },
+            i32 = {
+                -2 ^ 31,
+                2 ^ 31,
+            },
+            i64 = {
+                math.type and -2 ^ 63 or -2 ^ 53,
+                math.type and 2 ^ 63 or 2 ^ 53,
+            },
+        }) do
+            local v = assert(u[method](u))
+            assert.is_number(v)
+            if math.type and method ~= 'u64' and method ~= 'i64' then
+                assert.is_int(v)
+            end
+            assert.greater_or_equal(v, range[1])
+            assert.less(v, range[2])
+        end
+    end
+end
+
+function testcase.dsttbl()
+    local u = urandom()
+
+    for _, method in ipairs({
+        'get8u',
+        'get16u',
+        'get32u',
+        'get64u',
+        'get8i',
+        'get16i',
+        'get32i',
+        'get64i',
+        'double',
+        'float',
+    }) do
+        -- test that fill the values into the specified table
+        local t = {}
+        local arr = assert(u[method](u, 4, t))
+        assert.equal(arr, t)
+        assert.equal(#t, 4)
+
+        -- test that fill the values after the offset
+        t = {
+            'foo',
+            'bar',
+        }
+        arr = assert(u[method](u, 3, t, 2))
+        assert.equal(arr, t)
+        assert.equal(#t, 5)
+        assert.equal(t[1], 'foo')
+        assert.equal(t[2], 'bar')
+        for i = 3, 5 do
+            assert.is_number(t[i])
+        end
+
+        -- test that throws error with invalid arguments
+        local err = assert.throws(u[method], u, 1, 'foo')
+        assert.match(err, 'table expected, got string')
+        err = assert.throws(u[method], u, 1, {}, -1)
+        assert.match(err, 'offset must be greater than or equal to 0')
+
+        -- test that returns error if the index overflows
+        local data
+        data, err = u[method](u, 1, {}, 0x7FFFFFFF)
+        assert.is_nil(data)
+        assert.match(err, 'ERANGE')
+    end
+end
+
 function testcase.overflow()
     local u = urandom()
 
@@ -88,6 +1452,11 @@ function testcase.close()
         'get8u',
         'get16u',
         'get32u',
+        'get64u',
+        'get8i',
+        'get16i',
+        'get32i',
+        'get64i',
     }) do
         local data, err = u[method](u, 1)
         if method == 'bytes' then
@@ -99,3 +1468,71 @@ function testcase.close()
         assert.is_nil(err)
     end
 end
+
+function testcase.is_instance()
+    -- test that returns true for the instances
+    assert.is_true(urandom.is_instance(urandom()))
+    assert.is_true(urandom.is_instance(urandom({
+        seed = 'foo',
+    })))
+
+    -- test that returns false for the other values
+    assert.is_false(urandom.is_instance(urandom.buffer(8)))
+    assert.is_false(urandom.is_instance(io.stdout))
+    assert.is_false(urandom.is_instance({}))
+    assert.is_false(urandom.is_instance())
+end
+
+function testcase.ffi()
+    local uffi = require('os.urandom.ffi')
+    assert.is_boolean(uffi.available)
+
+    for _, u in ipairs({
+        urandom(),
+        urandom({
+            pool = 'chacha20',
+            buffer = 64,
+        }),
+    }) do
+        local r = uffi.wrap(u)
+
+        -- test that get random values through the wrapper
+        local s = assert(r:bytes(16))
+        assert.equal(#s, 16)
+        assert.not_equal(s, assert(r:bytes(16)))
+        assert.equal(#assert(r:bytes(1000)), 1000)
+        local v = assert(r:u32())
+        assert.is_int(v)
+        assert.greater_or_equal(v, 0)
+        assert.less_or_equal(v, 0xFFFFFFFF)
+        v = assert(r:double())
+        assert.greater_or_equal(v, 0)
+        assert.less(v, 1)
+        if uffi.available then
+            local buf = require('ffi').new('uint8_t[?]', 32)
+            assert.is_true(r:fill(buf, 32))
+
+            -- test that throws error if len is out of range of the buffer
+            local err = assert.throws(r.fill, r, buf, 33)
+            assert.match(err, 'len out of range')
+            err = assert.throws(r.fill, r, buf, -1)
+            assert.match(err, 'len must be a non-negative integer')
+            err = assert.throws(r.bytes, r, -1)
+            assert.match(err, 'nbyte must be a non-negative integer')
+        end
+    end
+
+    -- test that the wrapper returns the same values as the seeded instance
+    local a = uffi.wrap(urandom({
+        seed = 'ffi',
+    }))
+    local b = urandom({
+        seed = 'ffi',
+    })
+    assert.equal(a:bytes(16), b:bytes(16))
+    assert.equal(a:u32(), b:u32())
+
+    -- test that throws error if the argument is not an instance
+    local err = assert.throws(uffi.wrap, {})
+    assert.match(err, 'os.urandom instance expected')
+end